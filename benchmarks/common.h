@@ -0,0 +1,71 @@
+#ifndef TRANSLATADOR_BENCHMARK_COMMON_H
+#define TRANSLATADOR_BENCHMARK_COMMON_H
+
+#include <translatador.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static long read_file(const char* file_name, char** result) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+
+    char* buffer = malloc(size + 1);
+    if (fread(buffer, 1, size, file) != (size_t)size) {
+        free(buffer);
+        fclose(file);
+        return -1;
+    }
+    buffer[size] = 0;
+    fclose(file);
+
+    *result = buffer;
+    return size;
+}
+
+// Splits the given buffer in place into its non-empty lines, returning the number of lines found
+static size_t split_lines(char* buffer, char*** result) {
+    size_t capacity = 64;
+    size_t count = 0;
+    char** lines = malloc(capacity * sizeof(char*));
+
+    char* line = strtok(buffer, "\r\n");
+    while (line) {
+        if (count == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(char*));
+        }
+        lines[count++] = line;
+        line = strtok(0, "\r\n");
+    }
+
+    *result = lines;
+    return count;
+}
+
+static double now_seconds() {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static void print_build_info() {
+    TrlBuildInfo info;
+    trl_get_build_info(&info);
+    printf("Build: %s, int8 GEMM: %s, float GEMM: %s\n", info.native_gemm ? "native" : "wasm-compatible", info.int_gemm_kernel, info.float_gemm_backend);
+}
+
+static void print_last_error(const char* message) {
+    char* last_error = trl_get_last_error();
+    printf("%s: %s\n", message, last_error);
+    free(last_error);
+}
+
+#endif
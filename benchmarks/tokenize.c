@@ -0,0 +1,87 @@
+#include "common.h"
+
+// Measures segmentation and tokenization throughput over one or more text files, with one input per line. Comparing a
+// corpus of short messages against one of paragraphs shows the benefit of skipping the sentence splitter.
+
+void print_usage() {
+    printf("Usage: <model bundle> <input text file>... [--iterations <count>]\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    const char* bundle_file = argv[1];
+    int iterations = 20;
+    int file_count = 0;
+    const char** input_files = malloc(argc * sizeof(char*));
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            iterations = atoi(argv[++i]);
+        } else {
+            input_files[file_count++] = argv[i];
+        }
+    }
+    if (file_count == 0 || iterations <= 0) {
+        print_usage();
+        return 1;
+    }
+
+    const TrlModel* model = trl_create_model_from_bundle(bundle_file, 0, 0);
+    if (!model) {
+        print_last_error("Failed to load model");
+        return 1;
+    }
+
+    for (int file = 0; file < file_count; file++) {
+        char* input;
+        if (read_file(input_files[file], &input) < 0) {
+            printf("Failed to read %s\n", input_files[file]);
+            return 1;
+        }
+        char** lines;
+        const size_t line_count = split_lines(input, &lines);
+        const TrlString** strings = malloc(line_count * sizeof(TrlString*));
+
+        double total_seconds = 0.0;
+        // The first iteration is not measured, as it initializes the thread-local splitter
+        for (int iteration = -1; iteration < iterations; iteration++) {
+            const double start = now_seconds();
+            for (size_t i = 0; i < line_count; i++) {
+                // Strings cache their tokenization, so need to be recreated for every iteration
+                strings[i] = trl_create_string(lines[i]);
+                if (trl_tokenize_string(model, strings[i])) {
+                    print_last_error("Failed to tokenize");
+                    return 1;
+                }
+            }
+            const double seconds = now_seconds() - start;
+            if (iteration >= 0) {
+                total_seconds += seconds;
+            }
+            for (size_t i = 0; i < line_count; i++) {
+                trl_destroy_string(strings[i]);
+            }
+        }
+
+        const double total_lines = (double)line_count * iterations;
+        printf("%s: %zu lines x %d iterations in %.1f ms, %.1f lines/sec, %.2f us/line\n",
+               input_files[file], line_count, iterations, total_seconds * 1000.0,
+               total_lines / total_seconds, total_seconds * 1e6 / total_lines);
+
+        free(strings);
+        free(lines);
+        free(input);
+    }
+
+    free(input_files);
+    trl_destroy_model(model);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "common.h"
+
+// Measures translation throughput over a text file, with one segment per line. Running this against builds with and
+// without TRANSLATADOR_NATIVE_GEMM compares the native kernels against the portable WASM-compatible ones.
+
+void print_usage() {
+    printf("Usage: <model bundle> <input text file> [--config <yaml file>] [--batch-size <lines>] [--iterations <count>]\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    const char* bundle_file = argv[1];
+    const char* input_file = argv[2];
+    const char* config_file = 0;
+    size_t batch_size = 32;
+    int iterations = 5;
+
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage();
+            return 1;
+        }
+        if (strcmp(argv[i], "--config") == 0) {
+            config_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--batch-size") == 0) {
+            batch_size = (size_t)atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            iterations = atoi(argv[i + 1]);
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (batch_size == 0 || iterations <= 0) {
+        print_usage();
+        return 1;
+    }
+
+    char* config = 0;
+    if (config_file && read_file(config_file, &config) < 0) {
+        printf("Failed to read %s\n", config_file);
+        return 1;
+    }
+    char* input;
+    if (read_file(input_file, &input) < 0) {
+        printf("Failed to read %s\n", input_file);
+        return 1;
+    }
+
+    char** lines;
+    const size_t line_count = split_lines(input, &lines);
+    if (line_count == 0) {
+        printf("No input lines in %s\n", input_file);
+        return 1;
+    }
+
+    print_build_info();
+
+    const double load_start = now_seconds();
+    const TrlModel* model = trl_create_model_from_bundle(bundle_file, config, 0);
+    if (!model) {
+        print_last_error("Failed to load model");
+        return 1;
+    }
+    printf("Loaded model in %.1f ms\n", (now_seconds() - load_start) * 1000.0);
+
+    const TrlString** sources = malloc(line_count * sizeof(TrlString*));
+    const TrlString** targets = malloc(line_count * sizeof(TrlString*));
+    for (size_t i = 0; i < line_count; i++) {
+        sources[i] = trl_create_string(lines[i]);
+    }
+
+    double total_seconds = 0.0;
+    // The first iteration is not measured: it tokenizes all sources and allocates the graph workspace
+    for (int iteration = -1; iteration < iterations; iteration++) {
+        if (iteration == 0) {
+            trl_reset_model_stats(model);
+        }
+        const double start = now_seconds();
+        for (size_t offset = 0; offset < line_count; offset += batch_size) {
+            const size_t count = line_count - offset < batch_size ? line_count - offset : batch_size;
+            if (trl_translate(model, sources + offset, targets + offset, count)) {
+                print_last_error("Failed to translate");
+                return 1;
+            }
+            for (size_t i = offset; i < offset + count; i++) {
+                trl_destroy_string(targets[i]);
+            }
+        }
+        const double seconds = now_seconds() - start;
+        if (iteration >= 0) {
+            total_seconds += seconds;
+            printf("Iteration %d: %.1f ms\n", iteration + 1, seconds * 1000.0);
+        }
+    }
+
+    TrlModelStats stats;
+    trl_get_model_stats(model, &stats);
+
+    printf("Translated %zu lines x %d iterations in %.1f ms\n", line_count, iterations, total_seconds * 1000.0);
+    printf("Source: %.1f tokens/sec, target: %.1f tokens/sec\n", (double)stats.source_tokens / total_seconds, (double)stats.target_tokens / total_seconds);
+
+    for (size_t i = 0; i < line_count; i++) {
+        trl_destroy_string(sources[i]);
+    }
+    free(sources);
+    free(targets);
+    free(lines);
+    free(input);
+    free(config);
+    trl_destroy_model(model);
+    return 0;
+}
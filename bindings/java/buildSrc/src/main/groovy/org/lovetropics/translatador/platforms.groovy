@@ -4,17 +4,21 @@ enum NativeBuildPlatform {
     WINDOWS("windows", Os.WINDOWS, Arch.X64),
     WINDOWS_ARM64("windows-arm64", Os.WINDOWS, Arch.ARM64),
     MACOS("macos", Os.MACOS, Arch.X64),
-    LINUX("linux", Os.LINUX, Arch.X64),
+    // x86-64 Linux servers are our main deployment target, so we ship native GEMM kernels there rather than the
+    // portable WASM-compatible ones
+    LINUX("linux", Os.LINUX, Arch.X64, true),
     LINUX_ARM64("linux-arm64", Os.LINUX, Arch.ARM64),
 
     final String classifier
     final Os os
     final Arch arch
+    final boolean nativeGemm
 
-    NativeBuildPlatform(final String classifier, final Os os, final Arch arch) {
+    NativeBuildPlatform(final String classifier, final Os os, final Arch arch, final boolean nativeGemm = false) {
         this.classifier = classifier
         this.os = os
         this.arch = arch
+        this.nativeGemm = nativeGemm
     }
 
     static NativeBuildPlatform detect(final String buildArch) {
@@ -64,9 +64,36 @@ JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_cre
     return (size_t)result;
 }
 
+JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_createModelFromBundle(JNIEnv* env, jclass class, const jstring path_string, const jstring yaml_config_string, const jboolean verify_checksums) {
+    const char* path = (*env)->GetStringUTFChars(env, path_string, 0);
+    const char* yaml_config = yaml_config_string ? (*env)->GetStringUTFChars(env, yaml_config_string, 0) : 0;
+    const TrlModel* result = trl_create_model_from_bundle(path, yaml_config, verify_checksums ? 1 : 0);
+    (*env)->ReleaseStringUTFChars(env, path_string, path);
+    if (yaml_config) {
+        (*env)->ReleaseStringUTFChars(env, yaml_config_string, yaml_config);
+    }
+    if (!result) {
+        throw_error(env, "org/lovetropics/translatador/ModelException");
+    }
+    return (size_t)result;
+}
+
 JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_cloneModel(JNIEnv* env, jclass class, const jlong raw_model) {
     const TrlModel* model = (TrlModel *)(size_t)raw_model;
-    return (size_t)trl_clone_model(model);
+    const TrlModel* result = trl_clone_model(model);
+    if (!result) {
+        throw_error(env, "org/lovetropics/translatador/TranslationException");
+    }
+    return (size_t)result;
+}
+
+JNIEXPORT jdouble JNICALL Java_org_lovetropics_translatador_TranslatadorNative_warmupModel(JNIEnv* env, jclass class, const jlong raw_model) {
+    const TrlModel* model = (TrlModel *)(size_t)raw_model;
+    double duration_ms = 0.0;
+    if (trl_warmup_model(model, 0, &duration_ms)) {
+        throw_error(env, "org/lovetropics/translatador/TranslationException");
+    }
+    return duration_ms;
 }
 
 JNIEXPORT void JNICALL Java_org_lovetropics_translatador_TranslatadorNative_destroyModel(JNIEnv* env, jclass class, const jlong model) {
@@ -101,7 +128,12 @@ JNIEXPORT jobjectArray JNICALL Java_org_lovetropics_translatador_TranslatadorNat
 
     const jobjectArray results_array = (*env)->NewObjectArray(env, batch->count, (*env)->FindClass(env, "java/lang/String"), 0);
     for (jint i = 0; i < batch->count; i++) {
+        // Translations are decoded lazily, so this is where decoding fails
         const char* string = trl_get_string_utf((TrlString *)(size_t)batch->strings[i]);
+        if (!string) {
+            throw_error(env, "org/lovetropics/translatador/TranslationException");
+            return 0;
+        }
         (*env)->SetObjectArrayElement(env, results_array, i, (*env)->NewStringUTF(env, string));
     }
 
@@ -112,19 +144,71 @@ JNIEXPORT void JNICALL Java_org_lovetropics_translatador_TranslatadorNative_dest
     destroy_batch((struct Batch *)(size_t)raw_batch);
 }
 
+// Whether the string at the given index was translated. Entries that trl_translate_each did not get to are left unset
+int is_translated(const struct Batch* target, const TrlError* statuses, const jint index) {
+    return statuses[index] == TRL_OK && target->strings[index] != 0;
+}
+
+// Throws a TranslationException carrying the indices of the strings that failed, and the translations of all others.
+// If no string was translated, it carries neither
+void throw_partial_error(JNIEnv* env, const struct Batch* target, const TrlError* statuses) {
+    const jint count = target->count;
+    jint* failed_indices = malloc(count * sizeof(jint));
+    jint failed_count = 0;
+
+    const jobjectArray partial_array = (*env)->NewObjectArray(env, count, (*env)->FindClass(env, "java/lang/String"), 0);
+    for (jint i = 0; i < count; i++) {
+        // Translations are decoded lazily, so a string can still fail here
+        const char* string = is_translated(target, statuses, i) ? trl_get_string_utf(target->strings[i]) : 0;
+        if (string) {
+            (*env)->SetObjectArrayElement(env, partial_array, i, (*env)->NewStringUTF(env, string));
+        } else {
+            failed_indices[failed_count++] = i;
+        }
+    }
+
+    if (failed_count == count) {
+        free(failed_indices);
+        throw_error(env, "org/lovetropics/translatador/TranslationException");
+        return;
+    }
+
+    const jintArray failed_array = (*env)->NewIntArray(env, failed_count);
+    (*env)->SetIntArrayRegion(env, failed_array, 0, failed_count, failed_indices);
+    free(failed_indices);
+
+    char* last_error = trl_get_last_error();
+    const jstring message = (*env)->NewStringUTF(env, last_error ? last_error : "Unknown failure");
+    free(last_error);
+
+    const jclass exception_class = (*env)->FindClass(env, "org/lovetropics/translatador/TranslationException");
+    const jmethodID constructor = (*env)->GetMethodID(env, exception_class, "<init>", "(Ljava/lang/String;[I[Ljava/lang/String;)V");
+    (*env)->Throw(env, (jthrowable)(*env)->NewObject(env, exception_class, constructor, message, failed_array, partial_array));
+}
+
 jlong translate(JNIEnv* env, const TrlModel* model, const struct Batch* source) {
     const jint count = source->count;
 
-    struct Batch* target = malloc(sizeof(struct Batch) + count * sizeof(TrlString *));
+    // Zeroed, so that targets are null until they are translated, should translation fail before filling them in
+    struct Batch* target = calloc(1, sizeof(struct Batch) + count * sizeof(TrlString *));
     target->count = count;
+    TrlError* statuses = calloc(count, sizeof(TrlError));
 
-    const int error = trl_translate(model, (const TrlString * const *)&source->strings, (const TrlString * *)&target->strings, count);
+    // Failing strings are isolated, so that one bad string does not cost the translations of the rest of the batch
+    const int error = trl_translate_each(model, (const TrlString * const *)&source->strings, (const TrlString * *)&target->strings, statuses, count);
     if (error) {
+        throw_partial_error(env, target, statuses);
+        for (jint i = 0; i < count; i++) {
+            if (target->strings[i]) {
+                trl_destroy_string(target->strings[i]);
+            }
+        }
+        free(statuses);
         free(target);
-        throw_error(env, "org/lovetropics/translatador/TranslationException");
         return 0;
     }
 
+    free(statuses);
     return (size_t)target;
 }
 
@@ -142,6 +226,46 @@ JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_tra
     return result;
 }
 
+JNIEXPORT jint JNICALL Java_org_lovetropics_translatador_TranslatadorNative_getBatchSize(JNIEnv* env, jclass class, const jlong raw_batch) {
+    return ((const struct Batch *)(size_t)raw_batch)->count;
+}
+
+jlong translate_sharded(JNIEnv* env, const jlongArray models_array, const struct Batch* source) {
+    const jint model_count = (*env)->GetArrayLength(env, models_array);
+    jlong* raw_models = (*env)->GetLongArrayElements(env, models_array, 0);
+    const TrlModel** models = malloc(model_count * sizeof(TrlModel *));
+    for (jint i = 0; i < model_count; i++) {
+        models[i] = (TrlModel *)(size_t)raw_models[i];
+    }
+    (*env)->ReleaseLongArrayElements(env, models_array, raw_models, JNI_ABORT);
+
+    const jint count = source->count;
+    struct Batch* target = malloc(sizeof(struct Batch) + count * sizeof(TrlString *));
+    target->count = count;
+
+    const int error = trl_translate_sharded((const TrlModel * const *)models, model_count, (const TrlString * const *)&source->strings, (const TrlString * *)&target->strings, count);
+    free((void *)models);
+    if (error) {
+        free(target);
+        throw_error(env, "org/lovetropics/translatador/TranslationException");
+        return 0;
+    }
+
+    return (size_t)target;
+}
+
+JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_translateSharded(JNIEnv* env, jclass class, const jlongArray models_array, const jlong raw_source_batch) {
+    const struct Batch* source = (const struct Batch *)(size_t *)raw_source_batch;
+    return translate_sharded(env, models_array, source);
+}
+
+JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_translatePlainSharded(JNIEnv* env, jclass class, const jlongArray models_array, const jobjectArray strings_array) {
+    const struct Batch* source = create_batch(env, strings_array);
+    const jlong result = translate_sharded(env, models_array, source);
+    destroy_batch(source);
+    return result;
+}
+
 JNIEXPORT jlong JNICALL Java_org_lovetropics_translatador_TranslatadorNative_detectLanguage(JNIEnv* env, jclass class, const jstring string) {
     const char* c_string = (*env)->GetStringUTFChars(env, string, 0);
     TrlDetectedLangInfo info;
@@ -0,0 +1,473 @@
+package org.lovetropics.translatador;
+
+import java.lang.ref.Cleaner;
+import java.lang.ref.WeakReference;
+import java.time.Duration;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.ConcurrentLinkedDeque;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.ScheduledFuture;
+import java.util.concurrent.Semaphore;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.locks.ReentrantLock;
+
+/**
+ * A {@link TranslationModel} that can be used efficiently from many threads concurrently, by handing out a bounded set
+ * of {@link TranslationModel#fork() forks} of an underlying model.
+ * <p>
+ * Forks are created on demand when all existing forks are in use, up to the configured maximum size. Once that limit is
+ * reached, callers wait for a fork to be returned. Forks that have not been used for the configured idle timeout are
+ * closed again, down to the configured minimum size, including while the pool is not being used at all.
+ * <p>
+ * Large batches are additionally split across any forks that are idle at the time, so that a single large request does
+ * not run on one core while the rest of the pool waits. This never waits for further forks to become available.
+ * <p>
+ * Idle forks are handed out through a lock-free queue, and waiting is implemented with {@link java.util.concurrent}
+ * primitives rather than monitors, so that virtual threads never pin their carrier thread while waiting for a fork.
+ * <p>
+ * {@link PooledTranslationModel} does not take ownership of the model that it was created from, but it does own all
+ * forks that it creates. It must be {@link AutoCloseable closed} when no longer required. A pool that becomes unreachable
+ * without being closed has its forks closed once it is garbage collected, but only as promptly as the garbage collector
+ * gets to it.
+ *
+ * @see PooledTranslationModel#builder(TranslationModel)
+ */
+public class PooledTranslationModel implements TranslationModel {
+    // Shared by all pools, as trimming is quick and infrequent
+    private static final ScheduledExecutorService TRIMMER = Executors.newSingleThreadScheduledExecutor(runnable -> {
+        final Thread thread = new Thread(runnable, "translatador-pool-trimmer");
+        thread.setDaemon(true);
+        return thread;
+    });
+    private static final Cleaner CLEANER = Cleaner.create();
+    private static final long MIN_TRIM_INTERVAL_NANOS = TimeUnit.MILLISECONDS.toNanos(100);
+
+    private final TranslationModel prototype;
+    private final int minSize;
+    private final int maxSize;
+    private final long idleTimeoutNanos;
+    private final int shardSize;
+
+    // Most recently returned forks are at the head, so that the least recently used forks gather at the tail
+    private final ConcurrentLinkedDeque<Entry> idle = new ConcurrentLinkedDeque<>();
+    private final Semaphore permits;
+    // Only guards forking the prototype, which would otherwise contend on its monitor
+    private final ReentrantLock forkLock = new ReentrantLock();
+    private final AtomicBoolean trimming = new AtomicBoolean();
+    private final AtomicBoolean closed = new AtomicBoolean();
+
+    private final AtomicInteger size = new AtomicInteger();
+    private final AtomicInteger inUse = new AtomicInteger();
+    private final AtomicInteger peakInUse = new AtomicInteger();
+    private final AtomicLong acquisitions = new AtomicLong();
+    private final AtomicLong contendedAcquisitions = new AtomicLong();
+    private final AtomicLong waitNanos = new AtomicLong();
+    private final AtomicLong created = new AtomicLong();
+    private final AtomicLong retired = new AtomicLong();
+    private final AtomicLong shardedTranslations = new AtomicLong();
+    // Null if the pool can never hold more than its minimum size
+    private final ScheduledFuture<?> trimTask;
+    private final Cleaner.Cleanable cleanable;
+
+    private PooledTranslationModel(final TranslationModel prototype, final int minSize, final int maxSize, final Duration idleTimeout, final int shardSize) {
+        this.prototype = prototype;
+        this.minSize = minSize;
+        this.maxSize = maxSize;
+        idleTimeoutNanos = idleTimeout.toNanos();
+        this.shardSize = shardSize;
+        permits = new Semaphore(maxSize);
+        try {
+            for (int i = 0; i < minSize; i++) {
+                idle.addFirst(createEntry());
+            }
+        } catch (final RuntimeException e) {
+            Entry entry;
+            while ((entry = idle.pollFirst()) != null) {
+                retire(entry);
+            }
+            throw e;
+        }
+        if (minSize < maxSize) {
+            // Releasing a fork only trims forks that were idle for long enough by then, so a pool that goes quiet after a
+            // burst is trimmed from here instead. The trimmer only holds the pool weakly, so that it can still be collected
+            final long intervalNanos = Math.max(idleTimeoutNanos / 2, MIN_TRIM_INTERVAL_NANOS);
+            final WeakReference<PooledTranslationModel> pool = new WeakReference<>(this);
+            trimTask = TRIMMER.scheduleWithFixedDelay(() -> {
+                final PooledTranslationModel model = pool.get();
+                if (model != null && !model.closed.get()) {
+                    model.trimIdle(System.nanoTime());
+                }
+            }, intervalNanos, intervalNanos, TimeUnit.NANOSECONDS);
+        } else {
+            trimTask = null;
+        }
+        cleanable = CLEANER.register(this, new Abandoned(idle, trimTask));
+    }
+
+    /**
+     * @param model the model to fork pooled instances from
+     * @return a new {@link PooledTranslationModel} builder
+     */
+    public static Builder builder(final TranslationModel model) {
+        return new Builder(model);
+    }
+
+    @Override
+    public TranslationBatch translateBatch(final TranslationBatch batch) throws TranslationException {
+        final Entry entry = acquire();
+        final List<Entry> helpers = shardSize > 0 ? tryAcquireHelpers(batch.size() / shardSize - 1) : List.of();
+        try {
+            if (helpers.isEmpty()) {
+                return entry.model.translateBatch(batch);
+            }
+            shardedTranslations.incrementAndGet();
+            final List<TranslationModel> models = new ArrayList<>(helpers.size() + 1);
+            models.add(entry.model);
+            for (final Entry helper : helpers) {
+                models.add(helper.model);
+            }
+            return Translatador.translateSharded(models, batch);
+        } finally {
+            helpers.forEach(this::release);
+            release(entry);
+        }
+    }
+
+    /**
+     * {@link PooledTranslationModel} is already safe to use concurrently, so there is no need to fork it.
+     *
+     * @return this model
+     */
+    @Override
+    public TranslationModel fork() {
+        return this;
+    }
+
+    /**
+     * Warms up every fork that is currently idle in this pool. Forks that are created later are not warmed up by this,
+     * unless the model was loaded with {@code warmup: true}.
+     *
+     * @return the total time spent warming up forks
+     */
+    @Override
+    public Duration warmup() throws TranslationException {
+        Duration total = Duration.ZERO;
+        // Take each idle fork out through a permit like any other caller, so that we can't push the pool over its limit
+        for (int i = idle.size(); i > 0 && permits.tryAcquire(); i--) {
+            final Entry entry = idle.pollLast();
+            try {
+                if (entry == null) {
+                    break;
+                }
+                total = total.plus(entry.model.warmup());
+            } finally {
+                if (entry != null) {
+                    idle.addFirst(entry);
+                }
+                permits.release();
+            }
+        }
+        return total;
+    }
+
+    /**
+     * @return a snapshot of the current utilization of this pool
+     */
+    public Metrics metrics() {
+        return new Metrics(
+                size.get(),
+                maxSize,
+                inUse.get(),
+                peakInUse.get(),
+                acquisitions.get(),
+                contendedAcquisitions.get(),
+                waitNanos.get(),
+                created.get(),
+                retired.get(),
+                shardedTranslations.get()
+        );
+    }
+
+    @Override
+    public void close() {
+        if (closed.compareAndSet(false, true)) {
+            if (trimTask != null) {
+                trimTask.cancel(false);
+            }
+            // Forks that are in use will be closed as they are returned
+            Entry entry;
+            while ((entry = idle.pollFirst()) != null) {
+                retire(entry);
+            }
+            cleanable.clean();
+        }
+    }
+
+    private Entry acquire() {
+        checkOpen();
+        trimIdle(System.nanoTime());
+        acquisitions.incrementAndGet();
+        if (!permits.tryAcquire()) {
+            contendedAcquisitions.incrementAndGet();
+            final long waitStart = System.nanoTime();
+            try {
+                permits.acquire();
+            } catch (final InterruptedException e) {
+                Thread.currentThread().interrupt();
+                throw new TranslationException("Interrupted while waiting for a pooled model");
+            } finally {
+                waitNanos.addAndGet(System.nanoTime() - waitStart);
+            }
+        }
+
+        return takeEntry();
+    }
+
+    private List<Entry> tryAcquireHelpers(final int count) {
+        if (count <= 0) {
+            return List.of();
+        }
+        final List<Entry> helpers = new ArrayList<>(count);
+        // Only use forks that are free right now: waiting for more would delay this batch instead of speeding it up
+        while (helpers.size() < count && permits.tryAcquire()) {
+            try {
+                helpers.add(takeEntry());
+            } catch (final RuntimeException e) {
+                helpers.forEach(this::release);
+                throw e;
+            }
+        }
+        return helpers;
+    }
+
+    // Must only be called while holding a permit, which is released if this fails
+    private Entry takeEntry() {
+        try {
+            checkOpen();
+            Entry entry = idle.pollFirst();
+            if (entry == null) {
+                // Every existing fork is in use, but we're still within our limit
+                entry = createEntry();
+            }
+            peakInUse.accumulateAndGet(inUse.incrementAndGet(), Math::max);
+            return entry;
+        } catch (final RuntimeException e) {
+            permits.release();
+            throw e;
+        }
+    }
+
+    private void release(final Entry entry) {
+        inUse.decrementAndGet();
+        if (closed.get()) {
+            retire(entry);
+            permits.release();
+            return;
+        }
+        entry.lastUsedNanos = System.nanoTime();
+        idle.addFirst(entry);
+        permits.release();
+        trimIdle(entry.lastUsedNanos);
+        if (closed.get() && idle.remove(entry)) {
+            // We raced with close(), and so nobody else would close this entry
+            retire(entry);
+        }
+    }
+
+    private void trimIdle(final long now) {
+        if (!trimming.compareAndSet(false, true)) {
+            return;
+        }
+        try {
+            while (size.get() > minSize) {
+                final Entry oldest = idle.pollLast();
+                if (oldest == null) {
+                    break;
+                }
+                if (now - oldest.lastUsedNanos < idleTimeoutNanos) {
+                    idle.addLast(oldest);
+                    if (closed.get() && idle.remove(oldest)) {
+                        // We raced with close() while this entry was out of the queue
+                        retire(oldest);
+                    }
+                    break;
+                }
+                retire(oldest);
+            }
+        } finally {
+            trimming.set(false);
+        }
+    }
+
+    private Entry createEntry() {
+        final TranslationModel model;
+        forkLock.lock();
+        try {
+            model = prototype.fork();
+        } finally {
+            forkLock.unlock();
+        }
+        size.incrementAndGet();
+        created.incrementAndGet();
+        return new Entry(model);
+    }
+
+    private void retire(final Entry entry) {
+        size.decrementAndGet();
+        retired.incrementAndGet();
+        entry.model.close();
+    }
+
+    private void checkOpen() {
+        if (closed.get()) {
+            throw new IllegalStateException("Model pool has already been closed");
+        }
+    }
+
+    private static class Entry {
+        private final TranslationModel model;
+        private volatile long lastUsedNanos = System.nanoTime();
+
+        private Entry(final TranslationModel model) {
+            this.model = model;
+        }
+    }
+
+    // Closes the forks of a pool that was collected without being closed. Forks can only be idle by then, as a thread
+    // using one would still refer to the pool. This must not refer to the pool itself, or it would never be collected
+    private record Abandoned(ConcurrentLinkedDeque<Entry> idle, ScheduledFuture<?> trimTask) implements Runnable {
+        @Override
+        public void run() {
+            if (trimTask != null) {
+                trimTask.cancel(false);
+            }
+            Entry entry;
+            while ((entry = idle.pollFirst()) != null) {
+                entry.model.close();
+            }
+        }
+    }
+
+    /**
+     * A snapshot of the utilization of a {@link PooledTranslationModel}, which can be used to decide how it should be sized.
+     *
+     * @param size                  number of forks currently held by the pool
+     * @param maxSize               maximum number of forks that the pool may hold
+     * @param inUse                 number of forks currently translating
+     * @param peakInUse             highest number of forks that have been translating at once
+     * @param acquisitions          total number of translations started through the pool
+     * @param contendedAcquisitions number of translations that had to wait for a fork because the pool was at its limit
+     * @param waitNanos             total time spent waiting for a fork, in nanoseconds
+     * @param created               total number of forks created by the pool
+     * @param retired               total number of forks closed by the pool, including those closed for being idle
+     * @param shardedTranslations   number of translations that were split across multiple forks
+     */
+    public record Metrics(
+            int size,
+            int maxSize,
+            int inUse,
+            int peakInUse,
+            long acquisitions,
+            long contendedAcquisitions,
+            long waitNanos,
+            long created,
+            long retired,
+            long shardedTranslations
+    ) {
+        /**
+         * @return the fraction of the maximum pool size that is currently translating, between 0 and 1
+         */
+        public double utilization() {
+            return (double) inUse / maxSize;
+        }
+
+        /**
+         * @return the fraction of translations that had to wait for a fork, between 0 and 1
+         */
+        public double contentionRate() {
+            return acquisitions > 0 ? (double) contendedAcquisitions / acquisitions : 0.0;
+        }
+    }
+
+    public static class Builder {
+        private final TranslationModel model;
+        private int minSize = 1;
+        private int maxSize = Runtime.getRuntime().availableProcessors();
+        private Duration idleTimeout = Duration.ofMinutes(1);
+        private int shardSize = 64;
+
+        private Builder(final TranslationModel model) {
+            this.model = model;
+        }
+
+        /**
+         * Sets the number of forks that should be kept even when they are idle. Defaults to 1.
+         *
+         * @param minSize the minimum number of forks
+         * @return this {@link Builder}
+         */
+        public Builder minSize(final int minSize) {
+            this.minSize = minSize;
+            return this;
+        }
+
+        /**
+         * Sets the maximum number of forks that may be used concurrently. Defaults to the number of available processors.
+         *
+         * @param maxSize the maximum number of forks
+         * @return this {@link Builder}
+         */
+        public Builder maxSize(final int maxSize) {
+            this.maxSize = maxSize;
+            return this;
+        }
+
+        /**
+         * Sets how long a fork may go unused before it is closed, if there are more than the minimum number of forks.
+         * Defaults to 1 minute.
+         *
+         * @param idleTimeout the idle timeout
+         * @return this {@link Builder}
+         */
+        public Builder idleTimeout(final Duration idleTimeout) {
+            this.idleTimeout = idleTimeout;
+            return this;
+        }
+
+        /**
+         * Sets the minimum number of strings that each fork should translate when a batch is split across multiple idle
+         * forks. Batches smaller than twice this size are never split. Defaults to 64, or 0 to disable splitting.
+         *
+         * @param shardSize the minimum number of strings per fork
+         * @return this {@link Builder}
+         */
+        public Builder shardSize(final int shardSize) {
+            this.shardSize = shardSize;
+            return this;
+        }
+
+        /**
+         * Creates the pool, eagerly forking the minimum number of models.
+         *
+         * @return a new {@link PooledTranslationModel}
+         * @throws IllegalArgumentException if the sizes are out of range
+         */
+        public PooledTranslationModel build() {
+            if (maxSize < 1) {
+                throw new IllegalArgumentException("Maximum pool size must be at least 1");
+            }
+            if (minSize < 0 || minSize > maxSize) {
+                throw new IllegalArgumentException("Minimum pool size must be between 0 and the maximum size");
+            }
+            if (shardSize < 0) {
+                throw new IllegalArgumentException("Shard size must not be negative");
+            }
+            return new PooledTranslationModel(model, minSize, maxSize, idleTimeout, shardSize);
+        }
+    }
+}
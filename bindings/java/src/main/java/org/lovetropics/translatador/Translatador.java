@@ -3,6 +3,8 @@ package org.lovetropics.translatador;
 import java.io.IOException;
 import java.nio.file.Files;
 import java.nio.file.Path;
+import java.time.Duration;
+import java.util.List;
 import java.util.concurrent.locks.StampedLock;
 
 /**
@@ -44,12 +46,42 @@ public class Translatador {
         return Platform.tryDetect() != null;
     }
 
+    /**
+     * Translates one batch concurrently across multiple forks of the same model, by splitting it into shards with
+     * roughly equal numbers of tokens. The caller must have exclusive use of every given model for this call.
+     * Unlike translating with a single model, this is all-or-nothing: failures carry no partial translations.
+     * <p>
+     * If the models are not all native models, the batch is translated by the first model alone.
+     */
+    static TranslationBatch translateSharded(final List<TranslationModel> models, final TranslationBatch batch) throws TranslationException {
+        final long[] pointers = new long[models.size()];
+        for (int i = 0; i < pointers.length; i++) {
+            if (!(models.get(i) instanceof final NativeModel nativeModel)) {
+                return models.get(0).translateBatch(batch);
+            }
+            pointers[i] = nativeModel.checkOpen();
+        }
+        if (batch instanceof final NativeModel.NativeBatch nativeBatch) {
+            final long stamp = nativeBatch.lock.readLock();
+            try {
+                final long batchPointer = nativeBatch.checkOpen();
+                return new NativeModel.NativeBatch(TranslatadorNative.translateSharded(pointers, batchPointer));
+            } finally {
+                nativeBatch.lock.unlockRead(stamp);
+            }
+        } else {
+            return new NativeModel.NativeBatch(TranslatadorNative.translatePlainSharded(pointers, batch.get()));
+        }
+    }
+
     public static class Builder {
         private String yamlConfig;
         private byte[] model;
         private byte[] sourceVocab;
         private byte[] targetVocab;
         private byte[] shortList;
+        private Path bundle;
+        private boolean verifyChecksums = true;
 
         /**
          * Sets the optional Marian YAML configuration to be used to load this model with.
@@ -154,6 +186,35 @@ public class Translatador {
             return shortList(Files.readAllBytes(shortList));
         }
 
+        /**
+         * Sets a model bundle to load from, as produced by the {@code translatador-bundle} tool. The bundle contains
+         * the model, vocabularies, short list and configuration, and is memory-mapped rather than read onto the heap.
+         * <p>
+         * If set, any model, vocabularies or short list set on this builder are ignored. A configuration set through
+         * {@link Builder#yamlConfig(String)} overrides the configuration stored in the bundle.
+         *
+         * @param bundle the bundle path to load from
+         * @return this {@link Builder}
+         */
+        public Builder bundle(final Path bundle) {
+            this.bundle = bundle;
+            return this;
+        }
+
+        /**
+         * Sets whether the checksum of every section of a {@link Builder#bundle(Path) bundle} is verified while loading,
+         * such that a corrupted bundle fails to load rather than producing garbage. This requires reading the whole file
+         * instead of only the pages that are used, so it can be disabled where bundles are known to be intact.
+         * Defaults to {@code true}.
+         *
+         * @param verifyChecksums whether to verify bundle checksums
+         * @return this {@link Builder}
+         */
+        public Builder verifyChecksums(final boolean verifyChecksums) {
+            this.verifyChecksums = verifyChecksums;
+            return this;
+        }
+
         /**
          * Loads a {@link TranslationModel} from the given data.
          * <p>
@@ -164,6 +225,9 @@ public class Translatador {
          * @throws IllegalStateException if required model or vocabularies are not defined
          */
         public TranslationModel load() throws ModelException {
+            if (bundle != null) {
+                return new NativeModel(TranslatadorNative.createModelFromBundle(bundle.toAbsolutePath().toString(), yamlConfig, verifyChecksums));
+            }
             if (model == null) {
                 throw new IllegalStateException("Missing translation model binary");
             }
@@ -203,6 +267,13 @@ public class Translatador {
             return new NativeModel(TranslatadorNative.cloneModel(pointer));
         }
 
+        @Override
+        public synchronized Duration warmup() {
+            final long pointer = checkOpen();
+            final double millis = TranslatadorNative.warmupModel(pointer);
+            return Duration.ofNanos((long) (millis * 1_000_000.0));
+        }
+
         @Override
         public synchronized void close() {
             if (pointer != 0) {
@@ -241,6 +312,16 @@ public class Translatador {
                 }
             }
 
+            @Override
+            public int size() {
+                final long stamp = lock.readLock();
+                try {
+                    return TranslatadorNative.getBatchSize(checkOpen());
+                } finally {
+                    lock.unlockRead(stamp);
+                }
+            }
+
             @Override
             public void close() {
                 final long stamp = lock.writeLock();
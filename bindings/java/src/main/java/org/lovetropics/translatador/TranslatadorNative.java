@@ -17,18 +17,28 @@ class TranslatadorNative {
 
     public static native long createModel(String yamlConfig, byte[] model, byte[] sourceVocab, byte[] targetVocab, byte[] shortList) throws ModelException;
 
-    public static native long cloneModel(long model);
+    public static native long createModelFromBundle(String path, String yamlConfig, boolean verifyChecksums) throws ModelException;
+
+    public static native long cloneModel(long model) throws TranslationException;
+
+    public static native double warmupModel(long model) throws TranslationException;
 
     public static native void destroyModel(long model);
 
-    public static native String[] getBatchStrings(long batch);
+    public static native String[] getBatchStrings(long batch) throws TranslationException;
 
     public static native void destroyBatch(long batch);
 
+    public static native int getBatchSize(long batch);
+
     public static native long translate(long model, long batch) throws TranslationException;
 
     public static native long translatePlain(long model, String[] batch) throws TranslationException;
 
+    public static native long translateSharded(long[] models, long batch) throws TranslationException;
+
+    public static native long translatePlainSharded(long[] models, String[] batch) throws TranslationException;
+
     public static native long detectLanguage(String string) throws TranslationException;
 
     private static class Loader {
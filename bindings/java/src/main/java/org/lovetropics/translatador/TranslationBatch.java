@@ -55,9 +55,17 @@ public abstract class TranslationBatch implements AutoCloseable {
 
     /**
      * @return this batch's resolved plain strings
+     * @throws TranslationException if translated strings could not be decoded, which only happens once they are resolved
      */
     public abstract String[] get();
 
+    /**
+     * @return the number of strings in this batch, which may be cheaper than resolving them
+     */
+    public int size() {
+        return get().length;
+    }
+
     /**
      * @return this batch's resolved plain strings
      */
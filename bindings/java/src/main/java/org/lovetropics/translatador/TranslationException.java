@@ -1,7 +1,40 @@
 package org.lovetropics.translatador;
 
+/**
+ * Thrown when strings could not be translated.
+ * <p>
+ * If only some strings in a batch failed, the rest of the batch is still translated: {@link #failedIndices()} then
+ * identifies the failed strings, and {@link #partialTranslations()} holds the translations of all other strings.
+ */
 public class TranslationException extends RuntimeException {
+    private static final int[] NO_INDICES = new int[0];
+
+    private final int[] failedIndices;
+    private final String[] partialTranslations;
+
     public TranslationException(final String message) {
+        this(message, NO_INDICES, null);
+    }
+
+    public TranslationException(final String message, final int[] failedIndices, final String[] partialTranslations) {
         super(message);
+        this.failedIndices = failedIndices;
+        this.partialTranslations = partialTranslations;
+    }
+
+    /**
+     * @return the indices within the batch of the strings that could not be translated, or an empty array if the
+     * whole batch failed or the failure was not tied to a batch
+     */
+    public int[] failedIndices() {
+        return failedIndices.clone();
+    }
+
+    /**
+     * @return the translations of every string in the batch, with {@code null} at each of {@link #failedIndices()},
+     * or {@code null} if no strings were translated
+     */
+    public String[] partialTranslations() {
+        return partialTranslations != null ? partialTranslations.clone() : null;
     }
 }
@@ -1,5 +1,6 @@
 package org.lovetropics.translatador;
 
+import java.time.Duration;
 import java.util.Arrays;
 import java.util.List;
 
@@ -127,6 +128,19 @@ public interface TranslationModel extends AutoCloseable {
         return this;
     }
 
+    /**
+     * Translates synthetic batches through this model, so that lazily initialized native state is prepared before any
+     * real translation. Without this, the first translations after loading a model are much slower than steady state.
+     * <p>
+     * Models loaded with {@code warmup: true} in their YAML configuration are already warmed up, as are their forks.
+     *
+     * @return how long warmup took
+     * @throws TranslationException if warmup failed
+     */
+    default Duration warmup() throws TranslationException {
+        return Duration.ZERO;
+    }
+
     /**
      * Frees the resources associated with this {@link TranslationModel}. This should always be called once a
      * {@link TranslationModel} is no longer required.
@@ -162,6 +176,11 @@ public interface TranslationModel extends AutoCloseable {
             public TranslationModel fork() {
                 return TranslationModel.compose(first.fork(), second.fork());
             }
+
+            @Override
+            public Duration warmup() throws TranslationException {
+                return first.warmup().plus(second.warmup());
+            }
         };
     }
 }
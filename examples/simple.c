@@ -61,7 +61,13 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    printf("%s -> %s\n", trl_get_string_utf(source), trl_get_string_utf(target));
+    const char* target_utf = trl_get_string_utf(target);
+    if (!target_utf) {
+        printf("Failed to decode translation: %s", trl_get_last_error());
+        return 0;
+    }
+
+    printf("%s -> %s\n", trl_get_string_utf(source), target_utf);
 
     trl_destroy_string(source);
     trl_destroy_string(target);
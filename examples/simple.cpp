@@ -0,0 +1,30 @@
+#include <translatador.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::printf("Usage: <model bundle>");
+        return 0;
+    }
+
+    try {
+        const trl::Model model = trl::Model::from_bundle(argv[1]);
+
+        const trl::String target = model.translate("Hello from the C++ programming language!");
+        std::printf("%.*s\n", static_cast<int>(target.view().size()), target.view().data());
+
+        const std::vector<std::string> source = {"Good morning!", "How are you?"};
+        const trl::Batch translated = model.translate(source);
+        for (size_t i = 0; i < translated.size(); i++) {
+            const std::string_view line = translated[i];
+            std::printf("%s -> %.*s\n", source[i].c_str(), static_cast<int>(line.size()), line.data());
+        }
+    } catch (const trl::Error& error) {
+        std::printf("Failed to translate text: %s", error.what());
+    }
+
+    return 0;
+}
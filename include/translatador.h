@@ -25,6 +25,204 @@ typedef struct TrlModel TrlModel;
  */
 typedef struct TrlString TrlString;
 
+/**
+ * \brief Collects strings submitted concurrently from many threads into shared batches, which are translated by a set
+ * of models on worker threads. May be used from multiple threads.
+ */
+typedef struct TrlBatcher TrlBatcher;
+
+/**
+ * \brief Called by a \link TrlBatcher worker thread once a submitted string has been translated.
+ * \param user_data the pointer passed when the string was submitted
+ * \param target the translated string, or null if translation failed. The callee is expected to free this with \link trl_destroy_string
+ * \param status \link TRL_OK if translation was successful, or \link TRL_ERROR if not, in which case the error message
+ * is accessible through \link trl_get_last_error from within the callback
+ */
+typedef void (*TrlTranslateCallback)(void* user_data, const TrlString* target, TrlError status);
+
+/**
+ * \brief A token that can be passed along with requests to a \link TrlBatcher, and cancelled from any thread to stop
+ * those requests from being translated. May be used from multiple threads.
+ */
+typedef struct TrlCancellation TrlCancellation;
+
+/**
+ * \brief A handle to whichever model is currently published for a language pair, through which the model can be replaced
+ * while translations are in flight. May be used from multiple threads.
+ */
+typedef struct TrlModelHandle TrlModelHandle;
+
+/**
+ * \brief Called from a background thread once a model swap started by \link trl_swap_model_from_bundle has finished.
+ * \param user_data the pointer passed when the swap was started
+ * \param status \link TRL_OK if the new model was published, or \link TRL_ERROR if not, in which case the error message
+ * is accessible through \link trl_get_last_error from within the callback
+ */
+typedef void (*TrlSwapCallback)(void* user_data, TrlError status);
+
+/**
+ * \brief Called by \link trl_translate_stream to read the next part of the text to translate.
+ * \param user_data the pointer that was passed alongside this callback
+ * \param buffer the buffer to read UTF-8 text into, which may end partway through a character
+ * \param capacity the size of the buffer in bytes
+ * \param size where to store the number of bytes that were read, or 0 once the end of the text was reached
+ * \return zero if successful, or non-zero to stop translation with an error
+ */
+typedef int (*TrlStreamReader)(void* user_data, char* buffer, size_t capacity, size_t* size);
+
+/**
+ * \brief Called by \link trl_translate_stream with the next part of the translated text, in order.
+ * \param user_data the pointer that was passed alongside this callback
+ * \param data the translated UTF-8 text, which is only valid for the duration of this call
+ * \param size the size of the text in bytes
+ * \return zero if successful, or non-zero to stop translation with an error
+ */
+typedef int (*TrlStreamWriter)(void* user_data, const char* data, size_t size);
+
+/**
+ * \brief Usage statistics collected by a model, shared between all of its clones.
+ */
+typedef struct TrlModelStats {
+    // Number of translated batches that a short list was generated for
+    size_t short_list_batches;
+    // Sum of the short list sizes over all batches, such that the mean size is short_list_total_size / short_list_batches
+    size_t short_list_total_size;
+    size_t short_list_min_size;
+    size_t short_list_max_size;
+    // Short list size of the most recently translated batch
+    size_t short_list_last_size;
+    // Number of words that would be decoded against if no short list was used
+    size_t target_vocab_size;
+    // Number of batches passed through the model, including ones that did not use a short list
+    size_t translated_batches;
+    // Number of source tokens that were encoded, excluding padding
+    size_t source_tokens;
+    // Number of target tokens that were decoded, including the EOS marker of every segment
+    size_t target_tokens;
+    // Number of segments cut short as their output ended in an n-gram repeated degenerate-ngram-repeats times, and for
+    // longer than their source repeated itself
+    size_t repetition_truncations;
+    // Number of segments cut short as their output grew beyond degenerate-length-ratio times the length of their source
+    size_t length_truncations;
+} TrlModelStats;
+
+/**
+ * \brief Controls the synthetic batches translated by \link trl_warmup_model. Zero or null fields use their defaults.
+ */
+typedef struct TrlWarmupOptions {
+    // Lengths in tokens of the synthetic segments to translate, from short messages up to max-length-break by default
+    const size_t* segment_lengths;
+    size_t segment_length_count;
+    // Number of segments to translate together for each length, 8 by default
+    size_t batch_size;
+    // Number of passes over all lengths, 1 by default
+    size_t iterations;
+} TrlWarmupOptions;
+
+/**
+ * \brief Controls the configurations swept by \link trl_autotune. Zero or null fields use their defaults.
+ */
+typedef struct TrlAutotuneOptions {
+    // Numbers of clones translating concurrently, from 1 up to the number of hardware threads by default
+    const size_t* clone_counts;
+    size_t clone_count_count;
+    // Budgets in source tokens per mini-batch, where 0 translates every batch whole; 256 to 2048 by default
+    const size_t* mini_batch_words;
+    size_t mini_batch_words_count;
+    // Values of max-length-break to split segments at. This affects translations, so only the configured value is used by default
+    const size_t* max_length_breaks;
+    size_t max_length_break_count;
+    // Sizes in megabytes of the workspace reserved up front by every graph, only the configured size by default
+    const size_t* workspaces;
+    size_t workspace_count;
+    // Number of measured passes over the sample corpus for every configuration, 3 by default
+    size_t iterations;
+    // Upper bound on the p99 latency of a mini-batch. Above this, configurations are only chosen if none meets it. 0 by default, for no bound
+    double max_p99_latency_ms;
+} TrlAutotuneOptions;
+
+/**
+ * \brief The configuration recommended by \link trl_autotune, and how it performed.
+ */
+typedef struct TrlAutotuneResult {
+    // Number of model instances (the model and its clones) to translate with concurrently
+    size_t clones;
+    size_t mini_batch_words;
+    size_t max_length_break;
+    size_t workspace;
+    // Throughput over the sample corpus in source tokens per second, across all clones
+    double tokens_per_second;
+    // 99th percentile of the time taken to translate a single mini-batch
+    double p99_latency_ms;
+    // The recommended configuration as YAML, holding only the tuned options, to be passed when creating models. The caller is expected to free() this
+    char* config;
+} TrlAutotuneResult;
+
+/**
+ * \brief Controls how a \link TrlBatcher trades latency for throughput. Zero fields use their defaults.
+ */
+typedef struct TrlBatcherOptions {
+    // Longest time in milliseconds that a string waits for others to be batched with, 5 by default
+    double max_wait_ms;
+    // Source tokens at which a batch is translated without waiting any longer, 1024 by default
+    size_t max_batch_words;
+    // Number of queued requests above which requests are shed, lowest priority first. 0 by default, for no limit
+    size_t max_queued_requests;
+} TrlBatcherOptions;
+
+/**
+ * \brief Controls how a single request to a \link TrlBatcher is scheduled. Zero or null fields use their defaults.
+ */
+typedef struct TrlRequestOptions {
+    // Requests with a higher priority are batched first, and are shed last when the queue is full. 0 by default
+    int priority;
+    // Time in milliseconds after submission at which the request fails if it has not been translated. 0 by default, for no timeout.
+    // Expired requests are failed wherever they are queued once a worker next takes a batch, or to make room in a full queue
+    double timeout_ms;
+    // A token to cancel the request through, or null
+    const TrlCancellation* cancellation;
+} TrlRequestOptions;
+
+/**
+ * \brief Statistics collected by a \link TrlBatcher.
+ */
+typedef struct TrlBatcherStats {
+    size_t requests;
+    size_t batches;
+    // Source tokens across all batches, such that the fill ratio of batches is batch_words / (batches * max_batch_words)
+    size_t batch_words;
+    // Time between strings being submitted and their batch starting translation, in milliseconds
+    double total_queue_delay_ms;
+    double max_queue_delay_ms;
+    // Requests that were cancelled or timed out, whether while queued or while being translated
+    size_t cancelled_requests;
+    // Requests that were rejected or dropped from the queue as it was full
+    size_t shed_requests;
+} TrlBatcherStats;
+
+/**
+ * \brief Controls how \link trl_translate_stream splits up the text it reads. Zero fields use their defaults.
+ */
+typedef struct TrlStreamOptions {
+    // Bytes of text to read before splitting it into segments to translate as a batch, 8192 by default
+    size_t chunk_size;
+    // Chunks to hold in memory at once, whether being tokenized, translated or written. 2 per model plus 2 by default
+    size_t max_chunks_in_flight;
+} TrlStreamOptions;
+
+/**
+ * \brief Describes how this library was compiled and which kernels it selected for the current CPU.
+ */
+typedef struct TrlBuildInfo {
+    // Non-zero if compiled with native GEMM kernels and runtime CPU dispatch, or zero if compiled with the portable
+    // WASM-compatible kernels
+    int native_gemm;
+    // Instruction set used for 8-bit integer GEMM on this CPU, e.g. "avx512vnni", "avx2" or "wasm-fallback"
+    const char* int_gemm_kernel;
+    // Implementation used for floating point GEMM, e.g. "ruy" or "wasm-fallback"
+    const char* float_gemm_backend;
+} TrlBuildInfo;
+
 /**
  * \brief Represents an ISO 639-3 language code that may be detected by \link trl_detect_language
  */
@@ -187,6 +385,14 @@ typedef struct TrlDetectedLangInfo {
  */
 char* trl_get_last_error();
 
+/**
+ * \brief Returns the same string as \link trl_get_last_error, but without copying or clearing it.
+ * The returned string is owned by the library, and is only valid until the next call into the library from this thread.
+ *
+ * \return an error string, or null
+ */
+const char* trl_peek_last_error();
+
 /**
  * \brief Loads a translation model from the given binaries and configurations.
  * If the given data is malformed, null will be returned, and an error message should be accessible through \link trl_get_last_error.
@@ -202,20 +408,84 @@ char* trl_get_last_error();
  * \param source_vocab_size size of the source vocabulary
  * \param target_vocab optional vocabulary of the target language to load, or null to use a shared vocabulary between source and target
  * \param target_vocab_size size of the target vocabulary, or 0 if shared
- * \param short_list optional short list to load
- * \param short_list_size size of teh short list, or 0 if unused
+ * \param short_list optional short list to load, either in Marian's binary format or as a text lexical table. A text lexical table is converted into the binary format on load, limited by the first-num, best-num and threshold values of the `shortlist` option, which select the same words as they would for Marian's own text short lists. If `shortlist-cache` is configured with a file path, the converted short list is cached there for later loads.
+ * \param short_list_size size of the short list, or 0 if unused
  * \return the loaded model, or null if the model failed to load
  */
 const TrlModel* trl_create_model(const char* yaml_config, const char* model, size_t model_size, const char* source_vocab, size_t source_vocab_size, const char* target_vocab, size_t target_vocab_size, const char* short_list, size_t short_list_size);
 
+/**
+ * \brief Packs the given model inputs into a single bundle file that can be loaded with \link trl_create_model_from_bundle.
+ * Each input is stored in its own page-aligned section, with a checksum. The bundle is tagged with the CPU architecture
+ * and GEMM precision that it is intended for. A text lexical short list is converted to the binary format while packing.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * Takes the same inputs as \link trl_create_model, as well as:
+ * \param path file path to write the bundle to
+ * \param cpu optional CPU architecture tag that the bundle is intended for, or null to use the architecture of this build
+ * \return \link TRL_OK if the bundle was written, or \link TRL_ERROR if not
+ */
+TrlError trl_pack_bundle(const char* path, const char* yaml_config, const char* model, size_t model_size, const char* source_vocab, size_t source_vocab_size, const char* target_vocab, size_t target_vocab_size, const char* short_list, size_t short_list_size, const char* cpu);
+
+/**
+ * \brief Loads a translation model from a bundle file written by \link trl_pack_bundle.
+ * The bundle is memory-mapped, and the model and short list are used in place without copying.
+ * If the bundle is malformed, or packed for another CPU architecture, null will be returned, and an error message should be accessible through \link trl_get_last_error.
+ *
+ * \link trl_destroy_model should be used once the model is no longer needed.
+ *
+ * \param path file path of the bundle to load
+ * \param yaml_config optional Marian YAML configuration that overrides the configuration stored in the bundle, or null
+ * \param verify_checksums non-zero to verify the checksum of every section, which requires reading the whole file
+ * \return the loaded model, or null if the model failed to load
+ */
+const TrlModel* trl_create_model_from_bundle(const char* path, const char* yaml_config, int verify_checksums);
+
 /**
  * \brief Takes a copy of the given translation model. As \link TrlModel is not thread-safe, this might be used from another thread.
  *
+ * If the model is configured with `warmup: true`, the clone is warmed up before it is returned.
+ *
  * \param model the model to clone
- * \return a new model instance
+ * \return a new model instance, or null if warmup failed, with an error message accessible through \link trl_get_last_error
  */
 const TrlModel* trl_clone_model(const TrlModel* model);
 
+/**
+ * \brief Translates synthetic batches over a spread of segment lengths, so that the graph workspace is grown, the model
+ * weights are paged in and lazily prepared state is initialized before any real translation. Without this, the first
+ * translations after loading a model are much slower than steady state.
+ *
+ * Setting `warmup: true` in the YAML configuration runs this with default options whenever a model is created or cloned.
+ * Warmup batches are included in the statistics reported by \link trl_get_model_stats.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param model the model to warm up
+ * \param options the warmup options, or null to use the defaults
+ * \param duration_ms pointer to place the time taken by warmup in milliseconds (if successful), or null
+ * \return \link TRL_OK if warmup was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_warmup_model(const TrlModel* model, const TrlWarmupOptions* options, double* duration_ms);
+
+/**
+ * \brief Reads the usage statistics collected by the given model and all of its clones.
+ * \param model the model to read statistics from
+ * \param stats pointer to place the statistics
+ */
+void trl_get_model_stats(const TrlModel* model, TrlModelStats* stats);
+
+/**
+ * \brief Resets the usage statistics collected by the given model and all of its clones.
+ * \param model the model to reset statistics for
+ */
+void trl_reset_model_stats(const TrlModel* model);
+
+/**
+ * \brief Reports how this library was compiled, and which GEMM kernels are active on the current CPU.
+ * \param info pointer to place the build information. The strings it is populated with are static, and must not be freed
+ */
+void trl_get_build_info(TrlBuildInfo* info);
+
 /**
  * \brief Tears down and frees the memory held by the given \TrlModel.
  * \param model the model to destroy
@@ -230,18 +500,85 @@ void trl_destroy_model(const TrlModel* model);
 const TrlString* trl_create_string(const char* utf);
 
 /**
- * \brief Unwraps the plain string held by the given \link TrlString.
+ * \brief Wraps the given string by copying for use in translation, as with \link trl_create_string, but from a string
+ * of known size that does not need to be NUL-terminated.
+ * \param utf plain string to wrap
+ * \param size the size of the string in bytes
+ * \return a new \link TrlString that can be used for translation
+ */
+const TrlString* trl_create_string_n(const char* utf, size_t size);
+
+/**
+ * \brief Unwraps the plain string held by the given \link TrlString. The text of translations is only decoded once
+ * this is first called, which can fail: the error is then available from \link trl_get_last_error.
  * \param string the string to unwrap
- * \return a reference to the plain string held by the given \link TrlString
+ * \return a reference to the plain string held by the given \link TrlString, or null if it could not be decoded
  */
 const char* trl_get_string_utf(const TrlString* string);
 
+/**
+ * \brief Returns the size in bytes of the plain string held by the given \link TrlString, not including the NUL terminator.
+ * As with \link trl_get_string_utf, this decodes translations, and cannot fail once \link trl_get_string_utf succeeded.
+ * \param string the string to measure
+ * \return the size of the plain string, or 0 with the error available from \link trl_get_last_error if it could not
+ * be decoded
+ */
+size_t trl_get_string_size(const TrlString* string);
+
+/**
+ * \brief Checks whether decoding of any segment of the given translated string was cut short, as its output was found to
+ * be repeating itself or had grown too long for its source. The repetition is removed from such segments.
+ * \param string the translated string to check
+ * \return non-zero if the string was truncated, or zero if not or if the string was not produced by translation
+ */
+int trl_is_string_truncated(const TrlString* string);
+
 /**
  * \brief Tears down and frees the memory held by the given \link TrlString.
  * \param string the string to destroy
  */
 void trl_destroy_string(const TrlString* string);
 
+/**
+ * \brief Splits and tokenizes the given \link TrlString for the given model ahead of translation. This is otherwise done
+ * lazily by \link trl_translate, but may be useful so that the tokenization is included by \link trl_serialize_string.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param model the model to tokenize for
+ * \param string the string to tokenize
+ * \return \link TRL_OK if tokenization was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_tokenize_string(const TrlModel* model, const TrlString* string);
+
+/**
+ * \brief Serializes the given \link TrlString into a compact binary form that can be moved between processes or persisted.
+ * Any tokenization metadata held by the string is included, tagged with the vocabulary it was produced by. This allows
+ * a model with a matching vocabulary to skip tokenization after \link trl_deserialize_string.
+ * If an error occurs, the outputs will not be modified, and the error message will be accessible through \link trl_get_last_error.
+ *
+ * The caller is expected to free() the returned data after use.
+ *
+ * \param string the string to serialize
+ * \param data pointer to place the serialized data (if successful)
+ * \param size pointer to place the size of the serialized data (if successful)
+ * \return \link TRL_OK if serialization was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_serialize_string(const TrlString* string, char** data, size_t* size);
+
+/**
+ * \brief Reconstructs a \link TrlString from data produced by \link trl_serialize_string.
+ * If the data is malformed or from an incompatible version, null will be returned, and an error message should be accessible through \link trl_get_last_error.
+ *
+ * This function does not take ownership of the passed memory, and this may be freed by the caller once it returns. The
+ * data is therefore not borrowed: the text is copied once into the new string, and tokens are decoded from their
+ * variable-length encoding into the string's own tokenization.
+ *
+ * \param data serialized string data
+ * \param size size of the serialized data
+ * \return a new \link TrlString, or null if the data could not be deserialized
+ */
+const TrlString* trl_deserialize_string(const char* data, size_t size);
+
 /**
  * \brief Translates the given source strings into the target language using the given model.
  * If an error occurs, the target will not be modified, and the error message will be accessible through \link trl_get_last_error.
@@ -254,6 +591,276 @@ void trl_destroy_string(const TrlString* string);
  */
 TrlError trl_translate(const TrlModel* model, const TrlString* const* source, const TrlString** target, size_t count);
 
+/**
+ * \brief Translates the given source strings like \link trl_translate, but reports failures per string rather than
+ * failing the whole batch. If the batch fails, it is split in halves and retried until the failing strings are isolated,
+ * such that a single pathological string does not prevent the rest of the batch from being translated.
+ *
+ * Strings that were translated successfully are placed in target even if others failed, and failed strings are set to
+ * null. If any string failed, the error message of the first failure will be accessible through \link trl_get_last_error.
+ *
+ * \param model the model to use for translation
+ * \param source the source strings to translate
+ * \param target a pointer to place translated strings, or null for strings that failed
+ * \param statuses a pointer to place \link TRL_OK or \link TRL_ERROR for every string, or null
+ * \param count the number of strings to translate
+ * \return \link TRL_OK if every string was translated, or \link TRL_ERROR if any failed
+ */
+TrlError trl_translate_each(const TrlModel* model, const TrlString* const* source, const TrlString** target, TrlError* statuses, size_t count);
+
+/**
+ * \brief Translates an edited version of a previously translated string, only passing the segments (i.e. sentences)
+ * that changed to the model. Segments whose tokens are unchanged from the previous source take their translation from
+ * the previous target, and the text between segments is carried over from the new source as with \link trl_translate.
+ *
+ * Translations are only reused if the previous target is the string returned when translating the previous source with
+ * this model or a clone of it, by any translation function. Otherwise, such as if it was created from text or
+ * deserialized, the whole string is translated again.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param model the model to translate with
+ * \param previous_source the string before it was edited
+ * \param previous_target the translation of previous_source
+ * \param source the edited string
+ * \param target pointer to place the translated string (if successful). The caller is expected to free this with \link trl_destroy_string
+ * \return \link TRL_OK if translation was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_retranslate(const TrlModel* model, const TrlString* previous_source, const TrlString* previous_target, const TrlString* source, const TrlString** target);
+
+/**
+ * \brief Translates one large batch concurrently across multiple clones of the same model, with each clone running on
+ * its own thread. The strings are split into contiguous shards with roughly equal numbers of tokens, one per model, and
+ * the results are returned in the same order as if the batch had been passed to \link trl_translate.
+ * The first model translates on the calling thread. Every other model starts a worker thread the first time it is used
+ * here, which is kept until the model is destroyed, so that repeated calls do not start new threads.
+ *
+ * The passed models must all have been created through \link trl_clone_model from the same model (or be that model),
+ * and must not be used from other threads for the duration of this call.
+ * If an error occurs in any shard, none of the target strings will be set, and the error message will be accessible
+ * through \link trl_get_last_error.
+ *
+ * \param models the model clones to translate with
+ * \param model_count the number of model clones
+ * \param source array of source strings to translate
+ * \param target array to place translated strings into (if successful), of the same length as `source`
+ * \param count the number of strings in `source`
+ * \return \link TRL_OK if translation was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_translate_sharded(const TrlModel* const* models, size_t model_count, const TrlString* const* source, const TrlString** target, size_t count);
+
+/**
+ * \brief Translates a document of any length with a bounded amount of memory, reading it in chunks through `reader` and
+ * writing the translation through `writer` in the same order. Chunks are only cut at the start of a sentence, and never
+ * within a UTF-8 character, so sentences are split as they would be if the whole document was translated as one string.
+ * The exception is a sentence longer than 16 times `chunk_size`, which is cut to keep memory bounded: where
+ * max-length-break wraps it, possibly mid-word, or if it did not wrap, before its last token or else after the last whole
+ * UTF-8 character read.
+ *
+ * Reading and tokenization run on the calling thread, each model translates chunks on its own thread, and the
+ * translation is detokenized and written on another thread. `reader` and `writer` are each only called from one thread
+ * at a time. The passed models must all have been created through \link trl_clone_model from the same model (or be that
+ * model), and must not be used from other threads for the duration of this call.
+ * If an error occurs, including if either callback fails, text may already have been written, and the error message will
+ * be accessible through \link trl_get_last_error.
+ *
+ * \param models the model clones to translate with
+ * \param model_count the number of model clones
+ * \param reader the callback to read the source text from
+ * \param reader_data the pointer to pass to `reader`
+ * \param writer the callback to write the translated text to
+ * \param writer_data the pointer to pass to `writer`
+ * \param options the options to chunk the text with, or null to use the defaults
+ * \return \link TRL_OK if the whole text was translated and written, or \link TRL_ERROR if not
+ */
+TrlError trl_translate_stream(const TrlModel* const* models, size_t model_count, TrlStreamReader reader, void* reader_data, TrlStreamWriter writer, void* writer_data, const TrlStreamOptions* options);
+
+/**
+ * \brief Creates a batcher that translates with the given models, each on its own worker thread. Strings submitted
+ * from any thread are queued until either max_batch_words source tokens are waiting, or the oldest has waited max_wait_ms,
+ * and are then translated together by the next idle worker, highest priority first.
+ *
+ * Requests that are cancelled or time out are not translated if still queued. If already being translated, they stop
+ * being decoded between steps while the rest of their batch completes. With a beam size above 1, decoding cannot be
+ * interrupted, so cancellation only takes effect before a batch starts.
+ *
+ * The models must all have been created through \link trl_clone_model from the same model (or be that model). They are
+ * not owned by the batcher, and must not be used otherwise or destroyed until the batcher is destroyed.
+ * \link trl_destroy_batcher should be used once the batcher is no longer needed.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param models the models to translate with
+ * \param model_count the number of models, and thus worker threads
+ * \param options the batching options, or null to use the defaults
+ * \return a new batcher, or null if it could not be created
+ */
+TrlBatcher* trl_create_batcher(const TrlModel* const* models, size_t model_count, const TrlBatcherOptions* options);
+
+/**
+ * \brief Queues the given string for translation, calling the callback from a worker thread once it has been translated.
+ * The string is tokenized on the calling thread, and is not referenced after this returns. If the request is cancelled,
+ * times out or is shed, the callback is called with \link TRL_ERROR.
+ * If an error occurs (including if the queue is full), the callback will not be called, and the error message will be
+ * accessible through \link trl_get_last_error.
+ *
+ * \param batcher the batcher to submit to
+ * \param source the string to translate
+ * \param options the scheduling options of this request, or null to use the defaults
+ * \param callback the function to call with the translated string
+ * \param user_data a pointer passed on to the callback
+ * \return \link TRL_OK if the string was queued, or \link TRL_ERROR if not
+ */
+TrlError trl_batcher_submit(TrlBatcher* batcher, const TrlString* source, const TrlRequestOptions* options, TrlTranslateCallback callback, void* user_data);
+
+/**
+ * \brief Queues the given string for translation, and blocks until it has been translated.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param batcher the batcher to submit to
+ * \param source the string to translate
+ * \param options the scheduling options of this request, or null to use the defaults
+ * \param target pointer to place the translated string (if successful). The caller is expected to free this with \link trl_destroy_string
+ * \return \link TRL_OK if translation was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_batcher_translate(TrlBatcher* batcher, const TrlString* source, const TrlRequestOptions* options, const TrlString** target);
+
+/**
+ * \brief Creates a token to cancel requests to a \link TrlBatcher with.
+ * \link trl_destroy_cancellation should be used once the token is no longer needed.
+ * \return a new cancellation token
+ */
+TrlCancellation* trl_create_cancellation();
+
+/**
+ * \brief Cancels every request that the given token was passed to. This cannot be undone.
+ * \param cancellation the token to cancel
+ */
+void trl_cancel(TrlCancellation* cancellation);
+
+/**
+ * \brief Frees the given cancellation token. Requests that it was passed to are not cancelled by this.
+ * \param cancellation the token to destroy
+ */
+void trl_destroy_cancellation(TrlCancellation* cancellation);
+
+/**
+ * \brief Reads the statistics collected by the given batcher.
+ * \param batcher the batcher to read statistics from
+ * \param stats pointer to place the statistics
+ */
+void trl_get_batcher_stats(const TrlBatcher* batcher, TrlBatcherStats* stats);
+
+/**
+ * \brief Resets the statistics collected by the given batcher.
+ * \param batcher the batcher to reset statistics for
+ */
+void trl_reset_batcher_stats(const TrlBatcher* batcher);
+
+/**
+ * \brief Translates every string still queued, and then stops the worker threads and frees the given batcher.
+ * \param batcher the batcher to destroy
+ */
+void trl_destroy_batcher(TrlBatcher* batcher);
+
+/**
+ * \brief Creates a handle that translates with the given model, and through which it can later be replaced by
+ * \link trl_swap_model without coordinating with the threads that translate with it.
+ *
+ * The handle takes ownership of the model, which must not be used otherwise or destroyed by the caller. Clones are
+ * created as needed, such that every concurrent translation has its own instance, and are destroyed once they have been
+ * idle for a minute. A swap creates as many instances of the new model as the current one still has.
+ * \link trl_destroy_model_handle should be used once the handle is no longer needed.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param model the model to translate with
+ * \return a new handle, or null if it could not be created
+ */
+TrlModelHandle* trl_create_model_handle(const TrlModel* model);
+
+/**
+ * \brief Translates the given source strings with the model currently published by the given handle, as with
+ * \link trl_translate. May be called from multiple threads at once. If the model is swapped during translation, this
+ * completes with the previous model, which is only destroyed afterwards. Strings that were tokenized for a previous model
+ * are tokenized again if its vocabulary differs.
+ * If an error occurs, the target will not be modified, and the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param handle the handle to translate with
+ * \param source the source strings to translate
+ * \param target a pointer to place translated strings (if successful)
+ * \param count the number of strings to translate
+ * \return \link TRL_OK if translation was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_handle_translate(const TrlModelHandle* handle, const TrlString* const* source, const TrlString** target, size_t count);
+
+/**
+ * \brief Warms up the given model, along with as many clones as the current model has in use, and then publishes it to
+ * new translations through the handle. Translations still running on the previous model complete with it, and it is
+ * destroyed once the last of them finishes.
+ *
+ * The handle takes ownership of the model, which is destroyed if the swap fails.
+ * If an error occurs, the current model is kept, and the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param handle the handle to publish the model through
+ * \param model the model to publish
+ * \param warmup the options to warm up the new model with, or null to use the defaults
+ * \return \link TRL_OK if the model was published, or \link TRL_ERROR if not
+ */
+TrlError trl_swap_model(TrlModelHandle* handle, const TrlModel* model, const TrlWarmupOptions* warmup);
+
+/**
+ * \brief Loads a model from a bundle on a background thread, and then publishes it as with \link trl_swap_model, such
+ * that translation through the handle continues uninterrupted while the model loads. Checksums of the bundle are verified.
+ * Every handle loads on a single thread, started by its first call, so swaps queued in quick succession are published in
+ * order. If loading could not be queued, the callback will not be called, and the error message will be
+ * accessible through \link trl_get_last_error.
+ *
+ * \param handle the handle to publish the model through
+ * \param path the path of the bundle file to load, as with \link trl_create_model_from_bundle
+ * \param yaml_config YAML configuration overriding the one stored in the bundle, or null
+ * \param callback the function to call once the model was published or failed to load, or null
+ * \param user_data a pointer passed on to the callback
+ * \return \link TRL_OK if loading was started, or \link TRL_ERROR if not
+ */
+TrlError trl_swap_model_from_bundle(TrlModelHandle* handle, const char* path, const char* yaml_config, TrlSwapCallback callback, void* user_data);
+
+/**
+ * \brief Returns the version of the model currently published by the given handle, starting from 1 and incremented by
+ * every successful swap.
+ * \param handle the handle to read the version of
+ * \return the current version
+ */
+size_t trl_get_model_handle_version(const TrlModelHandle* handle);
+
+/**
+ * \brief Waits for any models still loading in the background, and then destroys the given handle along with its models.
+ * No translations may be running through the handle.
+ * \param handle the handle to destroy
+ */
+void trl_destroy_model_handle(TrlModelHandle* handle);
+
+/**
+ * \brief Measures translation throughput and latency on this machine over a sample corpus, sweeping the number of
+ * concurrent clones, mini-batch budgets, segment lengths and workspace sizes, and recommends the best configuration.
+ *
+ * Every configuration translates the whole corpus split into mini-batches of up to `mini-batch-words` source tokens,
+ * with the given number of clones taking mini-batches from a shared queue. The configuration with the highest throughput
+ * whose p99 mini-batch latency is within `max_p99_latency_ms` is chosen. Its YAML only holds the tuned
+ * `mini-batch-words`, `max-length-break` and `workspace`, which override the configuration stored in a bundle, and a
+ * `clones` key, which is not read by this library but records how many instances to create with \link trl_clone_model.
+ * Other options the model was created with are not included.
+ *
+ * This takes a while, and is meant to be run once when provisioning a machine. Instances are created for the duration
+ * of tuning, one set for each workspace size. Tuning batches are included in the statistics reported by \link trl_get_model_stats.
+ * If an error occurs, the error message will be accessible through \link trl_get_last_error.
+ *
+ * \param model the model to tune
+ * \param samples a sample of the strings expected in production, which are not modified
+ * \param sample_count the number of sample strings
+ * \param options the configurations to sweep, or null to use the defaults
+ * \param result pointer to place the recommended configuration (if successful)
+ * \return \link TRL_OK if tuning was successful, or \link TRL_ERROR if not
+ */
+TrlError trl_autotune(const TrlModel* model, const TrlString* const* samples, size_t sample_count, const TrlAutotuneOptions* options, TrlAutotuneResult* result);
+
 /**
  * \brief Analyzes the given string to determine which language it is most likely written in.
  * If an error occurs, the result will not be modified, and the error message will be accessible through \link trl_get_last_error.
@@ -0,0 +1,376 @@
+#ifndef TRANSLATADOR_HPP
+#define TRANSLATADOR_HPP
+
+#include <translatador.h>
+
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief A header-only C++17 layer over the C API in translatador.h, with move-only handles that free their native
+ * resources, and exceptions in place of error codes.
+ */
+namespace trl {
+    /**
+     * \brief Thrown when the library reports an error, holding the message that \link trl_get_last_error would return.
+     */
+    class Error : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    namespace detail {
+        [[noreturn]] inline void throw_last_error() {
+            const char* message = trl_peek_last_error();
+            throw Error(message ? message : "Unknown failure");
+        }
+
+        inline void check(const TrlError error) {
+            if (error != TRL_OK) {
+                throw_last_error();
+            }
+        }
+
+        // Ranges of strings are accepted generically, but a single string should never be taken for a range of characters
+        template<typename Range>
+        using enable_if_range = std::enable_if_t<!std::is_convertible_v<const Range&, std::string_view>, int>;
+
+        template<typename T>
+        T* check(T* result) {
+            if (!result) {
+                throw_last_error();
+            }
+            return result;
+        }
+    }
+
+    /**
+     * \brief Owns a \link TrlString.
+     */
+    class String {
+        const TrlString* handle = nullptr;
+
+    public:
+        String() = default;
+
+        /**
+         * \brief Copies the given text into native storage, without requiring it to be NUL-terminated.
+         */
+        explicit String(const std::string_view utf): handle(trl_create_string_n(utf.data(), utf.size())) {
+        }
+
+        /**
+         * \brief Takes ownership of the given string.
+         */
+        [[nodiscard]] static String adopt(const TrlString* handle) noexcept {
+            String string;
+            string.handle = handle;
+            return string;
+        }
+
+        String(String&& other) noexcept: handle(std::exchange(other.handle, nullptr)) {
+        }
+
+        String& operator=(String&& other) noexcept {
+            if (this != &other) {
+                reset();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        String(const String&) = delete;
+
+        String& operator=(const String&) = delete;
+
+        ~String() {
+            reset();
+        }
+
+        /**
+         * \brief Returns a view of the text held by this string, which is valid for as long as this string is.
+         * For translated strings, the text is decoded on first access, throwing \link Error if that fails.
+         */
+        [[nodiscard]] std::string_view view() const {
+            const char* utf = detail::check(trl_get_string_utf(handle));
+            return {utf, trl_get_string_size(handle)};
+        }
+
+        /**
+         * \brief Checks whether this string was translated from output that was cut short, as with \link trl_is_string_truncated.
+         */
+        [[nodiscard]] bool truncated() const {
+            return trl_is_string_truncated(handle) != 0;
+        }
+
+        [[nodiscard]] const TrlString* get() const noexcept {
+            return handle;
+        }
+
+        /**
+         * \brief Gives up ownership of the held string, which the caller is then expected to free with \link trl_destroy_string.
+         */
+        [[nodiscard]] const TrlString* release() noexcept {
+            return std::exchange(handle, nullptr);
+        }
+
+        void reset() noexcept {
+            if (handle) {
+                trl_destroy_string(std::exchange(handle, nullptr));
+            }
+        }
+
+        explicit operator bool() const noexcept {
+            return handle != nullptr;
+        }
+    };
+
+    /**
+     * \brief Owns a contiguous array of \link TrlString, in the form that the C API translates.
+     */
+    class Batch {
+        std::vector<const TrlString*> handles;
+
+        explicit Batch(std::vector<const TrlString*>&& handles) noexcept: handles(std::move(handles)) {
+        }
+
+    public:
+        Batch() = default;
+
+        /**
+         * \brief Copies every string of the given range into native storage. Accepts any range of values convertible to
+         * std::string_view, such as std::vector<std::string> or an array of string literals.
+         */
+        template<typename Range, detail::enable_if_range<Range> = 0>
+        explicit Batch(const Range& strings) {
+            using std::begin;
+            using std::end;
+            for (auto it = begin(strings); it != end(strings); ++it) {
+                const std::string_view utf(*it);
+                handles.push_back(trl_create_string_n(utf.data(), utf.size()));
+            }
+        }
+
+        Batch(const std::initializer_list<std::string_view> strings): Batch(std::vector<std::string_view>(strings)) {
+        }
+
+        /**
+         * \brief Allocates a batch of the given size with every entry unset, for the C API to place results into.
+         */
+        [[nodiscard]] static Batch with_size(const size_t size) {
+            return Batch(std::vector<const TrlString*>(size, nullptr));
+        }
+
+        Batch(Batch&& other) noexcept = default;
+
+        Batch& operator=(Batch&& other) noexcept {
+            if (this != &other) {
+                clear();
+                handles = std::move(other.handles);
+                other.handles.clear();
+            }
+            return *this;
+        }
+
+        Batch(const Batch&) = delete;
+
+        Batch& operator=(const Batch&) = delete;
+
+        ~Batch() {
+            clear();
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return handles.size();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return handles.empty();
+        }
+
+        /**
+         * \brief Returns a view of the text of the string at the given index, which is valid for as long as this batch is.
+         * As with \link String::view, translations are decoded on first access.
+         */
+        [[nodiscard]] std::string_view operator[](const size_t index) const {
+            const TrlString* handle = handles[index];
+            const char* utf = detail::check(trl_get_string_utf(handle));
+            return {utf, trl_get_string_size(handle)};
+        }
+
+        [[nodiscard]] bool truncated(const size_t index) const {
+            return trl_is_string_truncated(handles[index]) != 0;
+        }
+
+        [[nodiscard]] const TrlString* const* data() const noexcept {
+            return handles.data();
+        }
+
+        [[nodiscard]] const TrlString** data() noexcept {
+            return handles.data();
+        }
+
+        void clear() noexcept {
+            for (const TrlString* handle : handles) {
+                if (handle) {
+                    trl_destroy_string(handle);
+                }
+            }
+            handles.clear();
+        }
+    };
+
+    /**
+     * \brief Owns a \link TrlModel. As with the C API, a model should not be used from multiple threads: use \link clone
+     * to create an instance for each thread.
+     */
+    class Model {
+        const TrlModel* handle = nullptr;
+
+        explicit Model(const TrlModel* handle) noexcept: handle(handle) {
+        }
+
+    public:
+        Model() = default;
+
+        /**
+         * \brief Loads a model from the given binaries, as with \link trl_create_model. The binaries are copied where needed.
+         * \param yaml_config the YAML configuration, or empty to use the defaults
+         */
+        [[nodiscard]] static Model create(
+            const std::string_view model,
+            const std::string_view source_vocab,
+            const std::string_view target_vocab = {},
+            const std::string_view short_list = {},
+            const std::string& yaml_config = {}
+        ) {
+            return Model(detail::check(trl_create_model(
+                yaml_config.empty() ? nullptr : yaml_config.c_str(),
+                model.data(), model.size(),
+                source_vocab.data(), source_vocab.size(),
+                target_vocab.data(), target_vocab.size(),
+                short_list.data(), short_list.size()
+            )));
+        }
+
+        /**
+         * \brief Loads a model from a bundle file, as with \link trl_create_model_from_bundle.
+         * \param yaml_config YAML configuration overriding the one stored in the bundle, or empty
+         */
+        [[nodiscard]] static Model from_bundle(const std::string& path, const std::string& yaml_config = {}, const bool verify_checksums = false) {
+            return Model(detail::check(trl_create_model_from_bundle(
+                path.c_str(),
+                yaml_config.empty() ? nullptr : yaml_config.c_str(),
+                verify_checksums ? 1 : 0
+            )));
+        }
+
+        /**
+         * \brief Takes ownership of the given model.
+         */
+        [[nodiscard]] static Model adopt(const TrlModel* handle) noexcept {
+            return Model(handle);
+        }
+
+        Model(Model&& other) noexcept: handle(std::exchange(other.handle, nullptr)) {
+        }
+
+        Model& operator=(Model&& other) noexcept {
+            if (this != &other) {
+                reset();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        Model(const Model&) = delete;
+
+        Model& operator=(const Model&) = delete;
+
+        ~Model() {
+            reset();
+        }
+
+        [[nodiscard]] Model clone() const {
+            return Model(detail::check(trl_clone_model(handle)));
+        }
+
+        /**
+         * \brief Translates the given batch, returning a batch of the same size.
+         */
+        [[nodiscard]] Batch translate(const Batch& source) const {
+            Batch target = Batch::with_size(source.size());
+            detail::check(trl_translate(handle, source.data(), target.data(), source.size()));
+            return target;
+        }
+
+        /**
+         * \brief Translates every string of the given range, such as std::vector<std::string_view>.
+         */
+        template<typename Range, detail::enable_if_range<Range> = 0>
+        [[nodiscard]] Batch translate(const Range& source) const {
+            return translate(Batch(source));
+        }
+
+        [[nodiscard]] Batch translate(const std::initializer_list<std::string_view> source) const {
+            return translate(Batch(source));
+        }
+
+        [[nodiscard]] String translate(const String& source) const {
+            const TrlString* source_handle = source.get();
+            const TrlString* target = nullptr;
+            detail::check(trl_translate(handle, &source_handle, &target, 1));
+            return String::adopt(target);
+        }
+
+        [[nodiscard]] String translate(const std::string_view source) const {
+            return translate(String(source));
+        }
+
+        /**
+         * \brief Warms up the model, as with \link trl_warmup_model.
+         * \return the time taken in milliseconds
+         */
+        double warmup(const TrlWarmupOptions* options = nullptr) const {
+            double duration_ms = 0.0;
+            detail::check(trl_warmup_model(handle, options, &duration_ms));
+            return duration_ms;
+        }
+
+        [[nodiscard]] TrlModelStats stats() const {
+            TrlModelStats stats;
+            trl_get_model_stats(handle, &stats);
+            return stats;
+        }
+
+        [[nodiscard]] const TrlModel* get() const noexcept {
+            return handle;
+        }
+
+        /**
+         * \brief Gives up ownership of the held model, which the caller is then expected to free with \link trl_destroy_model.
+         */
+        [[nodiscard]] const TrlModel* release() noexcept {
+            return std::exchange(handle, nullptr);
+        }
+
+        void reset() noexcept {
+            if (handle) {
+                trl_destroy_model(std::exchange(handle, nullptr));
+            }
+        }
+
+        explicit operator bool() const noexcept {
+            return handle != nullptr;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef BISECTION_H
+#define BISECTION_H
+
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <vector>
+
+// Runs `run(begin, end)` over the items in [begin, end), halving the range whenever it throws until the items that fail
+// are isolated, whose errors are then recorded. `run` records its own results, and an item counts as done once it has
+// either a result or an error: items completed before a failure are kept, and not run again
+template<typename Result, typename Run>
+void run_bisecting(
+    const size_t begin,
+    const size_t end,
+    const std::vector<Result>& results,
+    std::vector<std::string>& errors,
+    const Run& run
+) {
+    bool done = true;
+    for (size_t i = begin; i < end && done; i++) {
+        done = results[i] || !errors[i].empty();
+    }
+    if (done) {
+        return;
+    }
+    try {
+        run(begin, end);
+    } catch (std::exception& e) {
+        if (end - begin == 1) {
+            errors[begin] = e.what();
+            return;
+        }
+        const size_t middle = begin + (end - begin) / 2;
+        run_bisecting(begin, middle, results, errors, run);
+        run_bisecting(middle, end, results, errors, run);
+    }
+}
+
+#endif
@@ -0,0 +1,272 @@
+#include "bundle.h"
+#include "serialization.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Layout (all integers are little-endian):
+//  magic: "TRLBUNDL"
+//  version: u32
+//  section count: u32
+//  cpu tag: char[16], NUL-padded
+//  precision tag: char[32], NUL-padded
+//  sections: kind u32, reserved u32, offset u64, size u64, checksum u64
+// Every section starts on a SECTION_ALIGNMENT boundary, so that it can be used in place once the file is mapped
+static constexpr char MAGIC[] = {'T', 'R', 'L', 'B', 'U', 'N', 'D', 'L'};
+static constexpr uint32_t VERSION = 1;
+static constexpr size_t CPU_TAG_SIZE = 16;
+static constexpr size_t PRECISION_TAG_SIZE = 32;
+static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 4 + CPU_TAG_SIZE + PRECISION_TAG_SIZE;
+static constexpr size_t SECTION_ENTRY_SIZE = 32;
+// Page size on most platforms, and well above the alignment that Marian requires for model memory
+static constexpr size_t SECTION_ALIGNMENT = 4096;
+
+enum class SectionKind : uint32_t {
+    config = 1,
+    model = 2,
+    source_vocab = 3,
+    target_vocab = 4,
+    short_list = 5,
+};
+
+const char* current_cpu_tag() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return "x86_64";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return "aarch64";
+#elif defined(__i386__) || defined(_M_IX86)
+    return "x86";
+#elif defined(__arm__) || defined(_M_ARM)
+    return "arm";
+#else
+    return "unknown";
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+#else
+    munmap(const_cast<char *>(data_), size_);
+#endif
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+    const HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_handle, &size) || size.QuadPart == 0) {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Could not read size of " + path);
+    }
+    const HANDLE mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_handle) {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Could not map " + path);
+    }
+    const void* data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error("Could not map " + path);
+    }
+    file->file_handle = file_handle;
+    file->mapping_handle = mapping_handle;
+    file->data_ = static_cast<const char *>(data);
+    file->size_ = static_cast<size_t>(size.QuadPart);
+#else
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    struct stat status = {};
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close(descriptor);
+        throw std::runtime_error("Could not read size of " + path);
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Could not map " + path);
+    }
+    file->data_ = static_cast<const char *>(data);
+    file->size_ = static_cast<size_t>(status.st_size);
+#endif
+    return file;
+}
+
+static void write_u32(std::ostream& output, const uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = static_cast<char>(value >> i * 8 & 0xff);
+    }
+    output.write(bytes, sizeof(bytes));
+}
+
+static void write_u64(std::ostream& output, const uint64_t value) {
+    char bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = static_cast<char>(value >> i * 8 & 0xff);
+    }
+    output.write(bytes, sizeof(bytes));
+}
+
+static void write_tag(std::ostream& output, const std::string& tag, const size_t size) {
+    if (tag.size() >= size) {
+        throw std::runtime_error("Bundle tag too long: " + tag);
+    }
+    std::vector<char> bytes(size, '\0');
+    std::memcpy(bytes.data(), tag.data(), tag.size());
+    output.write(bytes.data(), static_cast<std::streamsize>(size));
+}
+
+static uint32_t read_u32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << i * 8;
+    }
+    return value;
+}
+
+static uint64_t read_u64(const char* data) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << i * 8;
+    }
+    return value;
+}
+
+static std::string read_tag(const char* data, const size_t size) {
+    return std::string(data, strnlen(data, size));
+}
+
+static size_t align_up(const size_t value) {
+    return (value + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+void write_bundle(const std::string& path, const BundleSections& sections, const std::string& cpu, const std::string& precision) {
+    std::vector<std::pair<SectionKind, std::string_view>> entries;
+    entries.emplace_back(SectionKind::config, sections.config);
+    entries.emplace_back(SectionKind::model, sections.model);
+    entries.emplace_back(SectionKind::source_vocab, sections.source_vocab);
+    if (!sections.target_vocab.empty()) {
+        entries.emplace_back(SectionKind::target_vocab, sections.target_vocab);
+    }
+    if (!sections.short_list.empty()) {
+        entries.emplace_back(SectionKind::short_list, sections.short_list);
+    }
+
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        throw std::runtime_error("Could not create " + path);
+    }
+
+    output.write(MAGIC, sizeof(MAGIC));
+    write_u32(output, VERSION);
+    write_u32(output, static_cast<uint32_t>(entries.size()));
+    write_tag(output, cpu, CPU_TAG_SIZE);
+    write_tag(output, precision, PRECISION_TAG_SIZE);
+
+    size_t offset = align_up(HEADER_SIZE + entries.size() * SECTION_ENTRY_SIZE);
+    for (const auto& [kind, data] : entries) {
+        write_u32(output, static_cast<uint32_t>(kind));
+        write_u32(output, 0);
+        write_u64(output, offset);
+        write_u64(output, data.size());
+        write_u64(output, fingerprint(data.data(), data.size()));
+        offset = align_up(offset + data.size());
+    }
+
+    const std::vector<char> padding(SECTION_ALIGNMENT, '\0');
+    for (const auto& [kind, data] : entries) {
+        const size_t position = static_cast<size_t>(output.tellp());
+        output.write(padding.data(), static_cast<std::streamsize>(align_up(position) - position));
+        output.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    if (!output) {
+        throw std::runtime_error("Failed to write bundle to " + path);
+    }
+}
+
+Bundle open_bundle(const std::string& path, const bool verify_checksums) {
+    Bundle bundle;
+    bundle.file = MappedFile::open(path);
+    const char* data = bundle.file->data();
+    const size_t size = bundle.file->size();
+
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a model bundle: " + path);
+    }
+    const uint32_t version = read_u32(data + 8);
+    if (version != VERSION) {
+        throw std::runtime_error("Unsupported model bundle version: " + std::to_string(version));
+    }
+    const uint32_t section_count = read_u32(data + 12);
+    bundle.cpu = read_tag(data + 16, CPU_TAG_SIZE);
+    bundle.precision = read_tag(data + 16 + CPU_TAG_SIZE, PRECISION_TAG_SIZE);
+
+    if (section_count > (size - HEADER_SIZE) / SECTION_ENTRY_SIZE) {
+        throw std::runtime_error("Malformed model bundle: truncated section table");
+    }
+
+    for (uint32_t i = 0; i < section_count; i++) {
+        const char* entry = data + HEADER_SIZE + i * SECTION_ENTRY_SIZE;
+        const uint32_t kind = read_u32(entry);
+        const uint64_t offset = read_u64(entry + 8);
+        const uint64_t section_size = read_u64(entry + 16);
+        const uint64_t checksum = read_u64(entry + 24);
+
+        if (offset % SECTION_ALIGNMENT != 0 || offset > size || section_size > size - offset) {
+            throw std::runtime_error("Malformed model bundle: section out of bounds");
+        }
+        const std::string_view section(data + offset, section_size);
+        if (verify_checksums && fingerprint(section.data(), section.size()) != checksum) {
+            throw std::runtime_error("Model bundle checksum mismatch, the file may be corrupted: " + path);
+        }
+
+        switch (static_cast<SectionKind>(kind)) {
+            case SectionKind::config:
+                bundle.sections.config = section;
+                break;
+            case SectionKind::model:
+                bundle.sections.model = section;
+                break;
+            case SectionKind::source_vocab:
+                bundle.sections.source_vocab = section;
+                break;
+            case SectionKind::target_vocab:
+                bundle.sections.target_vocab = section;
+                break;
+            case SectionKind::short_list:
+                bundle.sections.short_list = section;
+                break;
+            default:
+                // Unknown sections may be added by later versions without breaking older readers
+                break;
+        }
+    }
+
+    if (bundle.sections.model.empty() || bundle.sections.source_vocab.empty()) {
+        throw std::runtime_error("Malformed model bundle: missing model or vocabulary");
+    }
+    return bundle;
+}
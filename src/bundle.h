@@ -0,0 +1,63 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// A read-only memory mapping of a whole file
+class MappedFile {
+    const char* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#endif
+
+    MappedFile() = default;
+
+public:
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    [[nodiscard]] const char* data() const {
+        return data_;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+};
+
+struct BundleSections {
+    std::string_view config;
+    std::string_view model;
+    std::string_view source_vocab;
+    // Empty if the vocabulary is shared between source and target
+    std::string_view target_vocab;
+    // Empty if no short list is used
+    std::string_view short_list;
+};
+
+struct Bundle {
+    // Keeps all sections alive
+    std::shared_ptr<MappedFile> file;
+    BundleSections sections;
+    std::string cpu;
+    std::string precision;
+};
+
+// Architecture tag of this build, used to reject bundles packed for another kind of CPU
+const char* current_cpu_tag();
+
+void write_bundle(const std::string& path, const BundleSections& sections, const std::string& cpu, const std::string& precision);
+
+Bundle open_bundle(const std::string& path, bool verify_checksums);
+
+#endif
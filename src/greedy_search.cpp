@@ -0,0 +1,239 @@
+#include "greedy_search.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+// A repeating n-gram must span at least this many tokens to count as a loop, such that short n-grams need more
+// occurrences than long ones before their output is cut short
+static constexpr size_t MIN_LOOP_LENGTH = 8;
+// Target tokens allowed on top of length-ratio, as very short sources can legitimately translate to several times their length
+static constexpr size_t LENGTH_RATIO_SLACK = 8;
+
+void DegenerationStats::reset() {
+    repetition_truncations.store(0, std::memory_order_relaxed);
+    length_truncations.store(0, std::memory_order_relaxed);
+}
+
+DegenerationLimits DegenerationLimits::parse(const marian::Options& options) {
+    return {
+        options.get<size_t>("degenerate-ngram-size", 0),
+        std::max<size_t>(options.get<size_t>("degenerate-ngram-repeats", 4), 2),
+        options.get<float>("degenerate-length-ratio", 0.0f)
+    };
+}
+
+bool DegenerationLimits::enabled() const {
+    return max_ngram_size > 0 || length_ratio > 0.0f;
+}
+
+// Returns the start of the run of words that each match the word `ngram_size` later, given a position within that run
+static size_t repetition_start(const marian::Word* words, size_t start, const size_t ngram_size) {
+    while (start > 0 && words[start - 1] == words[start - 1 + ngram_size]) {
+        start--;
+    }
+    return start;
+}
+
+std::vector<SourceProfile> DegenerationLimits::profile_sources(const std::shared_ptr<marian::data::CorpusBatch>& batch) const {
+    marian::data::SubBatch& source = *batch->front();
+    const size_t batch_size = source.batchSize();
+    std::vector<SourceProfile> profiles(batch_size, SourceProfile{0, 0});
+    if (!enabled()) {
+        return profiles;
+    }
+    marian::Words words;
+    for (size_t sentence = 0; sentence < batch_size; sentence++) {
+        // [width, batch size]
+        words.clear();
+        for (size_t position = 0; position < source.batchWidth(); position++) {
+            const size_t index = position * batch_size + sentence;
+            if (source.mask()[index] > 0.0f) {
+                words.push_back(source.data()[index]);
+            }
+        }
+        SourceProfile& profile = profiles[sentence];
+        profile.length = words.size();
+        for (size_t ngram_size = 1; ngram_size <= max_ngram_size; ngram_size++) {
+            size_t run = 0;
+            for (size_t i = 0; i + ngram_size < words.size(); i++) {
+                run = words[i] == words[i + ngram_size] ? run + 1 : 0;
+                // Only counts once the n-gram occurred at least twice
+                if (run >= ngram_size) {
+                    profile.repeated_length = std::max(profile.repeated_length, run + ngram_size);
+                }
+            }
+        }
+    }
+    return profiles;
+}
+
+std::optional<size_t> DegenerationLimits::find_truncation(const marian::Word* words, const size_t length, const SourceProfile& source, DegenerationStats& stats) const {
+    // Translations of repetitive sources are allowed to repeat for as long as the source does, with the same slack as
+    // for their length, as their repetition is tokenized differently
+    const size_t allowed_repetition = source.repeated_length > 0
+                                          ? static_cast<size_t>(std::max(length_ratio, 1.0f) * static_cast<float>(source.repeated_length)) + LENGTH_RATIO_SLACK
+                                          : 0;
+    for (size_t ngram_size = 1; ngram_size <= max_ngram_size; ngram_size++) {
+        const size_t occurrences = std::max(ngram_repeats, (MIN_LOOP_LENGTH + ngram_size - 1) / ngram_size);
+        const size_t loop_length = ngram_size * occurrences;
+        if (length < loop_length) {
+            continue;
+        }
+        // The output ends in a loop if every word of its tail matches the word one n-gram later
+        const marian::Word* loop = words + length - loop_length;
+        bool looping = true;
+        for (size_t i = 0; i + ngram_size < loop_length && looping; i++) {
+            looping = loop[i] == loop[i + ngram_size];
+        }
+        if (!looping) {
+            continue;
+        }
+        const size_t start = repetition_start(words, length - loop_length, ngram_size);
+        if (length - start <= allowed_repetition) {
+            continue;
+        }
+        stats.repetition_truncations.fetch_add(1, std::memory_order_relaxed);
+        // Keeps whole occurrences of the n-gram, up to as many tokens as the source repeated
+        return start + std::max(ngram_size, std::min(source.repeated_length, length - start) / ngram_size * ngram_size);
+    }
+
+    if (length_ratio > 0.0f) {
+        const auto max_length = static_cast<size_t>(length_ratio * static_cast<float>(source.length)) + LENGTH_RATIO_SLACK;
+        if (length > max_length) {
+            stats.length_truncations.fetch_add(1, std::memory_order_relaxed);
+            return max_length;
+        }
+    }
+    return std::nullopt;
+}
+
+SearchResult GreedySearch::search(
+    const std::shared_ptr<marian::ExpressionGraph>& graph,
+    const std::shared_ptr<marian::data::CorpusBatch>& batch,
+    const CancellationCheck& cancelled
+) const {
+    const size_t batch_size = batch->size();
+    const auto max_length = static_cast<size_t>(options->get<float>("max-length-factor") * static_cast<float>(batch->front()->batchWidth()));
+    const marian::Word eos_id = target_vocab->getEosId();
+    const marian::Word unk_id = target_vocab->getUnkId();
+    const bool allow_unk = options->get<bool>("allow-unk", false);
+    const DegenerationLimits limits = DegenerationLimits::parse(*options);
+    const std::vector<SourceProfile> sources = limits.profile_sources(batch);
+
+    // Fixed token matrix for the whole batch, with space for the terminating EOS of sentences that hit max_length
+    const size_t row_stride = max_length + 1;
+    marian::Words tokens(batch_size * row_stride);
+    std::vector<size_t> lengths(batch_size, 0);
+    std::vector<bool> truncated(batch_size, false);
+
+    std::vector<std::shared_ptr<marian::ScorerState>> states;
+    states.reserve(scorers.size());
+    for (const std::shared_ptr<marian::Scorer>& scorer : scorers) {
+        scorer->clear(graph);
+    }
+    for (const std::shared_ptr<marian::Scorer>& scorer : scorers) {
+        states.push_back(scorer->startState(graph, batch));
+    }
+
+    // Original batch index of each sentence that is still being decoded
+    std::vector<marian::IndexType> active(batch_size);
+    std::iota(active.begin(), active.end(), 0);
+
+    // Both are empty for the first step, where Marian starts from the initial state of every sentence
+    std::vector<marian::IndexType> previous_rows;
+    marian::Words previous_words;
+
+    std::vector<marian::IndexType> next_active;
+    next_active.reserve(batch_size);
+
+    for (size_t step = 0; !active.empty(); step++) {
+        // Marian applies batch indices to encoder states that were already shrunk by previous steps, so these must be the
+        // rows of the previous step's batch that are still being decoded, not the original sentence indices in `active`.
+        // With a single hypothesis per sentence, those are the same as `previous_rows` after the first step
+        const std::vector<marian::IndexType>& batch_indices = step == 0 ? active : previous_rows;
+        marian::Expr log_probs;
+        for (size_t i = 0; i < scorers.size(); i++) {
+            states[i] = scorers[i]->step(graph, states[i], previous_rows, previous_words, batch_indices, 1);
+            const marian::Expr scorer_log_probs = states[i]->getLogProbs().getLogits();
+            if (scorers.size() == 1) {
+                // Scaling by a single positive weight would not change which word is best
+                log_probs = scorer_log_probs;
+            } else {
+                const marian::Expr weighted_log_probs = scorers[i]->getWeight() * scorer_log_probs;
+                log_probs = i == 0 ? weighted_log_probs : log_probs + weighted_log_probs;
+            }
+        }
+
+        if (step == 0) {
+            graph->forward();
+        } else {
+            graph->forwardNext();
+        }
+
+        // If a short list is in use, the logits only cover the short listed words
+        const std::shared_ptr<marian::data::Shortlist> short_list = scorers[0]->getShortlist();
+        const auto vocab_dim = static_cast<size_t>(log_probs->shape()[-1]);
+        // [beam = 1, 1, active sentences, vocab]
+        const float* values = log_probs->val()->data<float>();
+
+        previous_rows.clear();
+        previous_words.clear();
+        next_active.clear();
+
+        for (size_t row = 0; row < active.size(); row++) {
+            const float* row_values = values + row * vocab_dim;
+            marian::Word best_word = eos_id;
+            float best_value = -std::numeric_limits<float>::infinity();
+            for (size_t index = 0; index < vocab_dim; index++) {
+                if (row_values[index] <= best_value) {
+                    continue;
+                }
+                const marian::Word word = short_list
+                                              ? marian::Word::fromWordIndex(short_list->reverseMap(static_cast<marian::WordIndex>(index)))
+                                              : marian::Word::fromWordIndex(index);
+                if (!allow_unk && word == unk_id) {
+                    continue;
+                }
+                best_word = word;
+                best_value = row_values[index];
+            }
+
+            const marian::IndexType sentence = active[row];
+            size_t& length = lengths[sentence];
+            tokens[sentence * row_stride + length++] = best_word;
+
+            if (best_word == eos_id) {
+                continue;
+            }
+            if (length >= max_length) {
+                tokens[sentence * row_stride + length++] = eos_id;
+                continue;
+            }
+            const std::optional<size_t> truncated_length = limits.find_truncation(&tokens[sentence * row_stride], length, sources[sentence], degeneration_stats);
+            if (truncated_length) {
+                length = *truncated_length;
+                tokens[sentence * row_stride + length++] = eos_id;
+                truncated[sentence] = true;
+                continue;
+            }
+            if (cancelled && cancelled(sentence)) {
+                length = 0;
+                continue;
+            }
+
+            previous_rows.push_back(static_cast<marian::IndexType>(row));
+            previous_words.push_back(best_word);
+            next_active.push_back(sentence);
+        }
+
+        active.swap(next_active);
+    }
+
+    SearchResult result{std::vector<marian::Words>(batch_size), std::move(truncated)};
+    for (size_t sentence = 0; sentence < batch_size; sentence++) {
+        const auto row_begin = tokens.begin() + static_cast<ptrdiff_t>(sentence * row_stride);
+        result.words[sentence].assign(row_begin, row_begin + static_cast<ptrdiff_t>(lengths[sentence]));
+    }
+    return result;
+}
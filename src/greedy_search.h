@@ -0,0 +1,96 @@
+#ifndef GREEDY_SEARCH_H
+#define GREEDY_SEARCH_H
+
+#include <marian.h>
+#include <translator/beam_search.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Reports whether decoding of a sentence in the batch should be abandoned. Checked between decoding steps, such that
+// cancelled sentences stop consuming CPU while the rest of the batch is still decoded
+typedef std::function<bool(size_t sentence)> CancellationCheck;
+
+struct DegenerationStats {
+    // Segments that were cut short as they ended in a repeating n-gram
+    std::atomic<size_t> repetition_truncations{0};
+    // Segments that were cut short as they grew too long for their source
+    std::atomic<size_t> length_truncations{0};
+
+    void reset();
+};
+
+// What the degeneration limits allow for a sentence, as measured on its source
+struct SourceProfile {
+    // Number of source tokens, including EOS and excluding padding
+    size_t length;
+    // Longest run of source tokens repeating an n-gram of up to max_ngram_size tokens, or 0 if none repeats. Output may
+    // repeat itself for about as long as its source does, as for "hahaha", "!!!!" or "no no no"
+    size_t repeated_length;
+};
+
+// Detects output that has degenerated, such that a hallucinating sentence stops being decoded once it is found to be
+// looping or to have outgrown its source, rather than keeping its batch alive until max-length-factor is reached
+struct DegenerationLimits {
+    // Longest n-gram that is detected repeating, or 0 (the default) to not detect repetition
+    size_t max_ngram_size;
+    // Consecutive occurrences of an n-gram at which the output is considered to be looping
+    size_t ngram_repeats;
+    // Target tokens allowed per source token of each sentence, or 0 (the default) to only apply max-length-factor to the
+    // whole batch
+    float length_ratio;
+
+    static DegenerationLimits parse(const marian::Options& options);
+
+    // Whether any limit is set, as otherwise no output is ever cut short
+    [[nodiscard]] bool enabled() const;
+
+    // Measures every sentence of the batch, in batch order
+    [[nodiscard]] std::vector<SourceProfile> profile_sources(const std::shared_ptr<marian::data::CorpusBatch>& batch) const;
+
+    // If the words decoded so far for a sentence have degenerated, records why into `stats` and returns the length to cut
+    // them back to. Only the end of the words is checked, as this is meant to be called after every decoding step: a
+    // repeating n-gram is cut back to its first occurrence, or to as much repetition as its source has
+    [[nodiscard]] std::optional<size_t> find_truncation(const marian::Word* words, size_t length, const SourceProfile& source, DegenerationStats& stats) const;
+};
+
+// The decoded words of each sentence in a batch, terminated by EOS, in batch order. Sentences that were cancelled are
+// left empty
+struct SearchResult {
+    std::vector<marian::Words> words;
+    // Whether each sentence was cut short by DegenerationLimits
+    std::vector<bool> truncated;
+};
+
+// Decoding specialized for a beam size of 1. Compared to marian::BeamSearch, this avoids all beam and history
+// bookkeeping: every step only takes the best word for each sentence, and finished sentences are immediately dropped
+// from the active batch.
+class GreedySearch {
+    const std::shared_ptr<marian::Options> options;
+    const std::vector<std::shared_ptr<marian::Scorer>>& scorers;
+    const std::shared_ptr<const marian::Vocab> target_vocab;
+    DegenerationStats& degeneration_stats;
+
+public:
+    GreedySearch(
+        std::shared_ptr<marian::Options> options,
+        const std::vector<std::shared_ptr<marian::Scorer>>& scorers,
+        std::shared_ptr<const marian::Vocab> target_vocab,
+        DegenerationStats& degeneration_stats
+    ): options(std::move(options)),
+       scorers(scorers),
+       target_vocab(std::move(target_vocab)),
+       degeneration_stats(degeneration_stats) {
+    }
+
+    SearchResult search(
+        const std::shared_ptr<marian::ExpressionGraph>& graph,
+        const std::shared_ptr<marian::data::CorpusBatch>& batch,
+        const CancellationCheck& cancelled = {}
+    ) const;
+};
+
+#endif
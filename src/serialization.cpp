@@ -0,0 +1,275 @@
+#include "serialization.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Layout (all multi-byte fixed-width integers are little-endian, `varint` is unsigned LEB128):
+//  magic: "TRLS"
+//  version: u8
+//  flags: u8 (FLAG_TOKENIZED)
+//  plain: varint length, followed by UTF-8 bytes
+//  if FLAG_TOKENIZED:
+//   vocab fingerprint: u64
+//   max segment length: varint
+//   segment split mode: u8
+//   segments: varint count, each with a varint token count, segment flags: u8 (SEGMENT_FLAG_TRUNCATED), followed by
+//   tokens of:
+//    varint id, varint offset of begin from the end of the previous token, varint length
+static constexpr char MAGIC[] = {'T', 'R', 'L', 'S'};
+static constexpr uint8_t VERSION = 1;
+static constexpr uint8_t FLAG_TOKENIZED = 1 << 0;
+static constexpr uint8_t SEGMENT_FLAG_TRUNCATED = 1 << 0;
+
+static constexpr uint8_t SPLIT_MODE_SENTENCE = 0;
+static constexpr uint8_t SPLIT_MODE_PARAGRAPH = 1;
+static constexpr uint8_t SPLIT_MODE_WRAPPED_TEXT = 2;
+
+uint64_t fingerprint(const char* data, const size_t size) {
+    // FNV-1a: we only need to tell apart inputs that were loaded by ourselves
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static uint8_t encode_split_mode(const SsplitMode mode) {
+    switch (mode) {
+        case SsplitMode::one_sentence_per_line:
+            return SPLIT_MODE_SENTENCE;
+        case SsplitMode::one_paragraph_per_line:
+            return SPLIT_MODE_PARAGRAPH;
+        case SsplitMode::wrapped_text:
+            return SPLIT_MODE_WRAPPED_TEXT;
+    }
+    throw std::runtime_error("Unrecognized ssplit-mode");
+}
+
+static SsplitMode decode_split_mode(const uint8_t mode) {
+    switch (mode) {
+        case SPLIT_MODE_SENTENCE:
+            return SsplitMode::one_sentence_per_line;
+        case SPLIT_MODE_PARAGRAPH:
+            return SsplitMode::one_paragraph_per_line;
+        case SPLIT_MODE_WRAPPED_TEXT:
+            return SsplitMode::wrapped_text;
+        default:
+            throw std::runtime_error("Malformed serialized string: unrecognized ssplit-mode");
+    }
+}
+
+// Writes nothing if `output` is null, which allows the same code to be used to measure the serialized size
+class Writer {
+    char* output;
+    size_t position = 0;
+
+public:
+    explicit Writer(char* output): output(output) {
+    }
+
+    void write_byte(const uint8_t value) {
+        if (output) {
+            output[position] = static_cast<char>(value);
+        }
+        position++;
+    }
+
+    void write_bytes(const char* data, const size_t size) {
+        if (output) {
+            std::memcpy(output + position, data, size);
+        }
+        position += size;
+    }
+
+    void write_varint(uint64_t value) {
+        while (value >= 0x80) {
+            write_byte(static_cast<uint8_t>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        write_byte(static_cast<uint8_t>(value));
+    }
+
+    void write_u64(const uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            write_byte(static_cast<uint8_t>(value >> i * 8 & 0xff));
+        }
+    }
+
+    [[nodiscard]] size_t size() const {
+        return position;
+    }
+};
+
+class Reader {
+    const char* data;
+    const size_t size;
+    size_t position = 0;
+
+public:
+    Reader(const char* data, const size_t size): data(data), size(size) {
+    }
+
+    uint8_t read_byte() {
+        if (position >= size) {
+            throw std::runtime_error("Malformed serialized string: unexpected end of data");
+        }
+        return static_cast<uint8_t>(data[position++]);
+    }
+
+    const char* read_bytes(const size_t count) {
+        if (count > remaining()) {
+            throw std::runtime_error("Malformed serialized string: unexpected end of data");
+        }
+        const char* result = data + position;
+        position += count;
+        return result;
+    }
+
+    uint64_t read_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = read_byte();
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Malformed serialized string: varint too long");
+    }
+
+    uint64_t read_u64() {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= static_cast<uint64_t>(read_byte()) << i * 8;
+        }
+        return value;
+    }
+
+    [[nodiscard]] size_t remaining() const {
+        return size - position;
+    }
+};
+
+static void write_string(Writer& writer, const std::string& plain, const TokenizedString* tokenized) {
+    writer.write_bytes(MAGIC, sizeof(MAGIC));
+    writer.write_byte(VERSION);
+    writer.write_byte(tokenized ? FLAG_TOKENIZED : 0);
+
+    writer.write_varint(plain.size());
+    writer.write_bytes(plain.data(), plain.size());
+
+    if (tokenized) {
+        const TokenizationParameters& parameters = tokenized->parameters;
+        writer.write_u64(parameters.vocab_fingerprint);
+        writer.write_varint(parameters.max_segment_length);
+        writer.write_byte(encode_split_mode(parameters.segment_split_mode));
+
+        writer.write_varint(tokenized->segments.size());
+        size_t last_end = 0;
+        for (const TokenizedSegment& segment : tokenized->segments) {
+            writer.write_varint(segment.tokens.size());
+            writer.write_byte(segment.truncated ? SEGMENT_FLAG_TRUNCATED : 0);
+            for (const Token& token : segment.tokens) {
+                writer.write_varint(token.id.toWordIndex());
+                writer.write_varint(token.begin - last_end);
+                writer.write_varint(token.end - token.begin);
+                last_end = token.end;
+            }
+        }
+    }
+}
+
+size_t serialized_size(const std::string& plain, const TokenizedString* tokenized) {
+    Writer writer(nullptr);
+    write_string(writer, plain, tokenized);
+    return writer.size();
+}
+
+void serialize_string(const std::string& plain, const TokenizedString* tokenized, char* output) {
+    Writer writer(output);
+    write_string(writer, plain, tokenized);
+}
+
+DeserializedString deserialize_string(const char* data, const size_t size) {
+    Reader reader(data, size);
+    if (std::memcmp(reader.read_bytes(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Malformed serialized string: bad magic");
+    }
+    const uint8_t version = reader.read_byte();
+    if (version != VERSION) {
+        throw std::runtime_error("Unsupported serialized string version: " + std::to_string(version));
+    }
+    const uint8_t flags = reader.read_byte();
+
+    const size_t plain_size = reader.read_varint();
+    // The only copy we make of the text: straight from the caller's buffer into its final storage
+    std::shared_ptr<std::string> plain = std::make_shared<std::string>(reader.read_bytes(plain_size), plain_size);
+
+    if (!(flags & FLAG_TOKENIZED)) {
+        return {std::move(plain), {}};
+    }
+
+    TokenizationParameters parameters{};
+    parameters.vocab_fingerprint = reader.read_u64();
+    parameters.max_segment_length = reader.read_varint();
+    parameters.segment_split_mode = decode_split_mode(reader.read_byte());
+
+    // Every segment and token takes at least one byte, so we can bound counts before allocating for them
+    const size_t segment_count = reader.read_varint();
+    if (segment_count > reader.remaining()) {
+        throw std::runtime_error("Malformed serialized string: too many segments");
+    }
+
+    std::vector<TokenizedSegment> segments(segment_count);
+    size_t last_end = 0;
+    for (TokenizedSegment& segment : segments) {
+        // Translated segments may be empty or longer than max_segment_length, which are only wrapped once translated from
+        const size_t token_count = reader.read_varint();
+        if (token_count > reader.remaining()) {
+            throw std::runtime_error("Malformed serialized string: bad segment length");
+        }
+        segment.truncated = (reader.read_byte() & SEGMENT_FLAG_TRUNCATED) != 0;
+        segment.tokens.reserve(token_count);
+        for (size_t i = 0; i < token_count; i++) {
+            const uint64_t id = reader.read_varint();
+            const uint64_t begin = last_end + reader.read_varint();
+            const uint64_t end = begin + reader.read_varint();
+            if (id > std::numeric_limits<marian::WordIndex>::max() || begin < last_end || end < begin || end > plain->size()) {
+                throw std::runtime_error("Malformed serialized string: bad token");
+            }
+            segment.tokens.emplace_back(marian::Word::fromWordIndex(id), begin, end);
+            last_end = end;
+        }
+    }
+
+    if (reader.remaining() > 0) {
+        throw std::runtime_error("Malformed serialized string: trailing data");
+    }
+
+    std::shared_ptr<TokenizedString> tokenized = std::make_shared<TokenizedString>(
+        std::move(parameters),
+        std::shared_ptr(plain),
+        std::move(segments)
+    );
+    return {std::move(plain), std::move(tokenized)};
+}
+
+std::shared_ptr<TokenizedString> bind_vocab(const TokenizedString& string, TokenizationParameters&& parameters) {
+    const size_t vocab_size = parameters.vocab->size();
+    for (const TokenizedSegment& segment : string.segments) {
+        for (const Token& token : segment.tokens) {
+            if (token.id.toWordIndex() >= vocab_size) {
+                throw std::runtime_error("Serialized string contains tokens outside of the vocabulary");
+            }
+        }
+    }
+    return std::make_shared<TokenizedString>(
+        std::move(parameters),
+        std::shared_ptr(string.plain),
+        std::vector(string.segments)
+    );
+}
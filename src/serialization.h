@@ -0,0 +1,30 @@
+#ifndef SERIALIZATION_H
+#define SERIALIZATION_H
+
+#include "tokenization.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Stable, non-cryptographic hash used to identify vocabularies and other model inputs
+uint64_t fingerprint(const char* data, size_t size);
+
+struct DeserializedString {
+    std::shared_ptr<std::string> plain;
+    // Null if the string was serialized without tokenization
+    std::shared_ptr<TokenizedString> tokenized;
+};
+
+size_t serialized_size(const std::string& plain, const TokenizedString* tokenized);
+
+// `output` must hold at least `serialized_size` bytes
+void serialize_string(const std::string& plain, const TokenizedString* tokenized, char* output);
+
+// Copies the text and decodes the tokens out of `data`, which the result does not refer to once this returns
+DeserializedString deserialize_string(const char* data, size_t size);
+
+// Deserialized tokenization is only matched against a vocabulary by fingerprint, so we need to check it before use
+std::shared_ptr<TokenizedString> bind_vocab(const TokenizedString& string, TokenizationParameters&& parameters);
+
+#endif
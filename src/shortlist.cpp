@@ -0,0 +1,376 @@
+#include "shortlist.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Must match the layout expected by marian::data::BinaryShortlistGenerator
+static constexpr uint64_t BINARY_SHORT_LIST_MAGIC = 0xF11A48D5013417F5;
+
+struct BinaryShortListHeader {
+    uint64_t magic;
+    // We load with content checks disabled, so this is left empty
+    uint64_t checksum;
+    uint64_t first_num;
+    uint64_t best_num;
+    uint64_t word_to_offset_size;
+    uint64_t short_lists_size;
+};
+
+// Bumped whenever the selection of targets changes, so that stale caches are rebuilt
+static constexpr char CACHE_MAGIC[] = {'T', 'R', 'L', 'S', 'L', 'C', '0', '2'};
+
+struct LexicalEntry {
+    marian::WordIndex source;
+    marian::WordIndex target;
+    float probability;
+};
+
+ShortListParameters ShortListParameters::parse(const marian::Options& options) {
+    ShortListParameters parameters{100, 100, 0.0f};
+    const std::vector<std::string> values = options.get<std::vector<std::string>>("shortlist", {});
+    if (values.size() > 1) {
+        parameters.first_num = std::stoul(values[1]);
+    }
+    if (values.size() > 2) {
+        parameters.best_num = std::stoul(values[2]);
+    }
+    if (values.size() > 3) {
+        parameters.threshold = std::stof(values[3]);
+    }
+    return parameters;
+}
+
+bool is_binary_short_list(const char* data, const size_t size) {
+    uint64_t magic;
+    if (size < sizeof(magic)) {
+        return false;
+    }
+    std::memcpy(&magic, data, sizeof(magic));
+    return magic == BINARY_SHORT_LIST_MAGIC;
+}
+
+template<typename F>
+static void parallel_for(const size_t count, const F function) {
+    const size_t thread_count = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), count));
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t thread_index = 0; thread_index < thread_count; thread_index++) {
+        threads.emplace_back([=, &function] {
+            const size_t begin = count * thread_index / thread_count;
+            const size_t end = count * (thread_index + 1) / thread_count;
+            for (size_t i = begin; i < end; i++) {
+                function(i);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Splits the table into roughly equal chunks, each ending on a line boundary
+static std::vector<std::string_view> split_lines(const std::string_view text, const size_t chunk_count) {
+    std::vector<std::string_view> chunks;
+    size_t chunk_start = 0;
+    for (size_t i = 1; i <= chunk_count && chunk_start < text.size(); i++) {
+        size_t chunk_end = i == chunk_count ? text.size() : std::max(chunk_start, text.size() * i / chunk_count);
+        chunk_end = text.find('\n', chunk_end);
+        chunk_end = chunk_end == std::string_view::npos ? text.size() : chunk_end + 1;
+        chunks.push_back(text.substr(chunk_start, chunk_end - chunk_start));
+        chunk_start = chunk_end;
+    }
+    return chunks;
+}
+
+static std::string_view next_field(std::string_view& line) {
+    const size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) {
+        line = {};
+        return {};
+    }
+    size_t end = line.find_first_of(" \t\r", start);
+    end = end == std::string_view::npos ? line.size() : end;
+    const std::string_view field = line.substr(start, end - start);
+    line.remove_prefix(end);
+    return field;
+}
+
+static void parse_lexical_entries(
+    std::string_view chunk,
+    const marian::Vocab& source_vocab,
+    const marian::Vocab& target_vocab,
+    const float threshold,
+    std::vector<LexicalEntry>& entries
+) {
+    std::string probability_string;
+    while (!chunk.empty()) {
+        size_t line_end = chunk.find('\n');
+        line_end = line_end == std::string_view::npos ? chunk.size() : line_end;
+        std::string_view line = chunk.substr(0, line_end);
+        chunk.remove_prefix(std::min(chunk.size(), line_end + 1));
+
+        const std::string_view target = next_field(line);
+        const std::string_view source = next_field(line);
+        const std::string_view probability_field = next_field(line);
+        if (probability_field.empty()) {
+            continue;
+        }
+        if (source == "NULL" || target == "NULL") {
+            continue;
+        }
+
+        probability_string.assign(probability_field);
+        const float probability = std::strtof(probability_string.c_str(), nullptr);
+        // As in marian::data::LexicalShortlistGenerator::prune, only probabilities above the threshold are kept
+        if (probability <= threshold) {
+            continue;
+        }
+
+        entries.push_back(LexicalEntry{
+            source_vocab[std::string(source)].toWordIndex(),
+            target_vocab[std::string(target)].toWordIndex(),
+            probability
+        });
+    }
+}
+
+static std::string build_binary_short_list(
+    const std::string_view lexical_table,
+    const marian::Vocab& source_vocab,
+    const marian::Vocab& target_vocab,
+    const ShortListParameters& parameters
+) {
+    const size_t thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    const std::vector<std::string_view> chunks = split_lines(lexical_table, thread_count);
+
+    std::vector<std::vector<LexicalEntry>> chunk_entries(chunks.size());
+    parallel_for(chunks.size(), [&](const size_t i) {
+        parse_lexical_entries(chunks[i], source_vocab, target_vocab, parameters.threshold, chunk_entries[i]);
+    });
+
+    // Group all candidates by source word, so that each source word can then be processed independently
+    const size_t source_vocab_size = source_vocab.size();
+    std::vector<size_t> candidate_offsets(source_vocab_size + 1, 0);
+    for (const std::vector<LexicalEntry>& entries : chunk_entries) {
+        for (const LexicalEntry& entry : entries) {
+            if (entry.source < source_vocab_size) {
+                candidate_offsets[entry.source + 1]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < source_vocab_size; i++) {
+        candidate_offsets[i + 1] += candidate_offsets[i];
+    }
+
+    std::vector<std::pair<float, marian::WordIndex>> candidates(candidate_offsets.back());
+    std::vector<size_t> insert_positions(candidate_offsets.begin(), candidate_offsets.end() - 1);
+    for (std::vector<LexicalEntry>& entries : chunk_entries) {
+        for (const LexicalEntry& entry : entries) {
+            if (entry.source < source_vocab_size) {
+                candidates[insert_positions[entry.source]++] = {entry.probability, entry.target};
+            }
+        }
+        entries = {};
+    }
+
+    // Keep the `best_num` most likely targets for every source word, in place at the start of its candidates. This
+    // matches marian::data::LexicalShortlistGenerator, such that a lexical table gives the same short list either way:
+    // words below first_num still count towards best_num, and ties are broken towards higher target ids
+    std::vector<uint64_t> short_list_sizes(source_vocab_size, 0);
+    parallel_for(source_vocab_size, [&](const size_t source) {
+        const auto begin = candidates.begin() + static_cast<ptrdiff_t>(candidate_offsets[source]);
+        auto end = candidates.begin() + static_cast<ptrdiff_t>(candidate_offsets[source + 1]);
+
+        // Candidates are in table order, and a target listed more than once for a source takes its last probability
+        std::reverse(begin, end);
+        std::stable_sort(begin, end, [](const auto& left, const auto& right) {
+            return left.second < right.second;
+        });
+        end = std::unique(begin, end, [](const auto& left, const auto& right) {
+            return left.second == right.second;
+        });
+
+        const size_t size = std::min<size_t>(parameters.best_num, end - begin);
+        std::partial_sort(begin, begin + static_cast<ptrdiff_t>(size), end, std::greater<>());
+        short_list_sizes[source] = size;
+    });
+
+    std::vector<uint64_t> word_to_offset(source_vocab_size + 1, 0);
+    for (size_t i = 0; i < source_vocab_size; i++) {
+        word_to_offset[i + 1] = word_to_offset[i] + short_list_sizes[i];
+    }
+
+    const BinaryShortListHeader header{
+        BINARY_SHORT_LIST_MAGIC,
+        0,
+        parameters.first_num,
+        parameters.best_num,
+        word_to_offset.size(),
+        word_to_offset.back()
+    };
+
+    const size_t word_to_offset_bytes = word_to_offset.size() * sizeof(uint64_t);
+    std::string result(sizeof(header) + word_to_offset_bytes + header.short_lists_size * sizeof(marian::WordIndex), '\0');
+    std::memcpy(result.data(), &header, sizeof(header));
+    std::memcpy(result.data() + sizeof(header), word_to_offset.data(), word_to_offset_bytes);
+
+    char* short_lists = result.data() + sizeof(header) + word_to_offset_bytes;
+    parallel_for(source_vocab_size, [&](const size_t source) {
+        for (size_t i = 0; i < short_list_sizes[source]; i++) {
+            const marian::WordIndex target = candidates[candidate_offsets[source] + i].second;
+            std::memcpy(short_lists + (word_to_offset[source] + i) * sizeof(marian::WordIndex), &target, sizeof(target));
+        }
+    });
+
+    return result;
+}
+
+static uint64_t mix(uint64_t hash, const uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= value >> i * 8 & 0xff;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static std::optional<std::string> read_cached_short_list(const std::string& path, const uint64_t key) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return {};
+    }
+    char magic[sizeof(CACHE_MAGIC)];
+    uint64_t cached_key;
+    input.read(magic, sizeof(magic));
+    input.read(reinterpret_cast<char *>(&cached_key), sizeof(cached_key));
+    if (!input || std::memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || cached_key != key) {
+        return {};
+    }
+    std::string short_list{std::istreambuf_iterator(input), std::istreambuf_iterator<char>()};
+    if (!is_binary_short_list(short_list.data(), short_list.size())) {
+        return {};
+    }
+    return short_list;
+}
+
+// Unique between processes and between threads of this process, so that concurrent writers never share a file
+static std::string temporary_cache_path(const std::string& path) {
+    static std::atomic<uint64_t> counter{0};
+#ifdef _WIN32
+    const unsigned long process_id = GetCurrentProcessId();
+#else
+    const long process_id = static_cast<long>(getpid());
+#endif
+    return path + "." + std::to_string(process_id) + "." + std::to_string(counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+}
+
+// Atomically replaces `path` if it exists, such that readers see either the previous file or the new one
+static bool replace_file(const std::string& from, const std::string& path) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), path.c_str()) == 0;
+#endif
+}
+
+static void write_cached_short_list(const std::string& path, const uint64_t key, const std::string& short_list) {
+    // The cache is only an optimization, so we never fail model loading because of it
+    const std::string temporary_path = temporary_cache_path(path);
+    {
+        std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+        output.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        output.write(reinterpret_cast<const char *>(&key), sizeof(key));
+        output.write(short_list.data(), static_cast<std::streamsize>(short_list.size()));
+        if (!output) {
+            output.close();
+            std::remove(temporary_path.c_str());
+            return;
+        }
+    }
+    // Concurrent loads never observe a partially written or missing cache, and the last writer wins
+    if (!replace_file(temporary_path, path)) {
+        std::remove(temporary_path.c_str());
+    }
+}
+
+std::string build_short_list(
+    const char* lexical_table,
+    const size_t lexical_table_size,
+    const marian::Vocab& source_vocab,
+    const uint64_t source_fingerprint,
+    const marian::Vocab& target_vocab,
+    const uint64_t target_fingerprint,
+    const ShortListParameters& parameters,
+    const std::string& cache_path
+) {
+    uint64_t key = fingerprint(lexical_table, lexical_table_size);
+    key = mix(key, source_fingerprint);
+    key = mix(key, target_fingerprint);
+    key = mix(key, parameters.first_num);
+    key = mix(key, parameters.best_num);
+    uint32_t threshold_bits;
+    std::memcpy(&threshold_bits, &parameters.threshold, sizeof(threshold_bits));
+    key = mix(key, threshold_bits);
+
+    if (!cache_path.empty()) {
+        if (std::optional<std::string> cached = read_cached_short_list(cache_path, key)) {
+            return std::move(cached.value());
+        }
+    }
+
+    std::string short_list = build_binary_short_list(
+        std::string_view(lexical_table, lexical_table_size),
+        source_vocab,
+        target_vocab,
+        parameters
+    );
+
+    if (!cache_path.empty()) {
+        write_cached_short_list(cache_path, key, short_list);
+    }
+    return short_list;
+}
+
+void ShortListStats::record(const size_t size) {
+    batches.fetch_add(1, std::memory_order_relaxed);
+    total_size.fetch_add(size, std::memory_order_relaxed);
+    last_size.store(size, std::memory_order_relaxed);
+
+    size_t min = min_size.load(std::memory_order_relaxed);
+    while (size < min && !min_size.compare_exchange_weak(min, size, std::memory_order_relaxed)) {
+    }
+    size_t max = max_size.load(std::memory_order_relaxed);
+    while (size > max && !max_size.compare_exchange_weak(max, size, std::memory_order_relaxed)) {
+    }
+}
+
+void ShortListStats::reset() {
+    batches.store(0, std::memory_order_relaxed);
+    total_size.store(0, std::memory_order_relaxed);
+    min_size.store(std::numeric_limits<size_t>::max(), std::memory_order_relaxed);
+    max_size.store(0, std::memory_order_relaxed);
+    last_size.store(0, std::memory_order_relaxed);
+}
+
+marian::Ptr<marian::data::Shortlist> TrackedShortListGenerator::generate(const marian::Ptr<marian::data::CorpusBatch> batch) const {
+    marian::Ptr<marian::data::Shortlist> short_list = generator->generate(batch);
+    if (short_list) {
+        stats.record(short_list->indices().size());
+    }
+    return short_list;
+}
@@ -0,0 +1,68 @@
+#ifndef SHORTLIST_H
+#define SHORTLIST_H
+
+#include <marian.h>
+#include <data/shortlist.h>
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+
+struct ShortListParameters {
+    // Target words with an id below `first_num` are always included, so are not stored per source word
+    size_t first_num;
+    size_t best_num;
+    float threshold;
+
+    // Reads from Marian's `shortlist` option: [path, first-num, best-num, threshold] - the path is ignored
+    static ShortListParameters parse(const marian::Options& options);
+};
+
+bool is_binary_short_list(const char* data, size_t size);
+
+// Builds Marian's binary short list format from a text lexical table of `target source probability` lines, selecting
+// the same targets for each source word as marian::data::LexicalShortlistGenerator would.
+// If `cache_path` is non-empty, a previously built short list for the same inputs will be loaded from there, or the
+// newly built short list will be written there.
+std::string build_short_list(
+    const char* lexical_table,
+    size_t lexical_table_size,
+    const marian::Vocab& source_vocab,
+    uint64_t source_fingerprint,
+    const marian::Vocab& target_vocab,
+    uint64_t target_fingerprint,
+    const ShortListParameters& parameters,
+    const std::string& cache_path
+);
+
+struct ShortListStats {
+    std::atomic<size_t> batches{0};
+    std::atomic<size_t> total_size{0};
+    std::atomic<size_t> min_size{std::numeric_limits<size_t>::max()};
+    std::atomic<size_t> max_size{0};
+    std::atomic<size_t> last_size{0};
+
+    void record(size_t size);
+
+    void reset();
+};
+
+// Wraps a short list generator to record the size of every short list that it produces
+class TrackedShortListGenerator : public marian::data::ShortlistGenerator {
+    const std::shared_ptr<marian::data::ShortlistGenerator> generator;
+    ShortListStats& stats;
+
+public:
+    TrackedShortListGenerator(
+        std::shared_ptr<marian::data::ShortlistGenerator> generator,
+        ShortListStats& stats
+    ): generator(std::move(generator)),
+       stats(stats) {
+    }
+
+    marian::Ptr<marian::data::Shortlist> generate(marian::Ptr<marian::data::CorpusBatch> batch) const override;
+};
+
+#endif
@@ -1,8 +1,13 @@
 #include "tokenization.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <data/types.h>
 #include <string>
 #include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 static thread_local ug::ssplit::SentenceSplitter SENTENCE_SPLITTER = ug::ssplit::SentenceSplitter();
 
@@ -19,6 +24,10 @@ SsplitMode parse_ssplit_mode(const std::string& mode) {
 }
 
 [[nodiscard]] std::string_view gap_before(const TokenizedString& string, const size_t segment_index) {
+    if (!string.is_detokenized()) {
+        // Tokens don't have byte ranges yet, but gaps are always carried over from the source
+        return (*string.gaps)[segment_index];
+    }
     size_t segment_start = 0;
     size_t last_segment_end = 0;
     if (segment_index > 0) {
@@ -30,42 +39,173 @@ SsplitMode parse_ssplit_mode(const std::string& mode) {
     return std::string_view(*string.plain).substr(last_segment_end, segment_start - last_segment_end);
 }
 
-std::shared_ptr<TokenizedString> tokenize(const std::shared_ptr<std::string>& plain, TokenizationParameters&& parameters) {
-    std::vector<TokenizedSegment> tokenized_segments;
+// Non-ASCII characters that may end a segment: the Unicode Sentence_Terminal characters of the Basic Multilingual Plane
+// (e.g. U+3002 '。', U+FF1F '？', U+061F '؟', U+06D4 '۔', U+0964 '।', U+0589 '։'), the ellipsis, and line separators
+static constexpr char32_t BOUNDARY_CODE_POINTS[] = {
+    0x0085, 0x0589, 0x061D, 0x061E, 0x061F, 0x06D4, 0x0700, 0x0701, 0x0702, 0x07F9, 0x0837, 0x0839, 0x083D, 0x083E,
+    0x0964, 0x0965, 0x104A, 0x104B, 0x1362, 0x1367, 0x1368, 0x166E, 0x1735, 0x1736, 0x1803, 0x1809, 0x1944, 0x1945,
+    0x1AA8, 0x1AA9, 0x1AAA, 0x1AAB, 0x1B5A, 0x1B5B, 0x1B5E, 0x1B5F, 0x1B7D, 0x1B7E, 0x1C3B, 0x1C3C, 0x1C7E, 0x1C7F,
+    0x2026, 0x2028, 0x2029, 0x203C, 0x203D, 0x2047, 0x2048, 0x2049, 0x2E2E, 0x2E3C, 0x2E53, 0x2E54, 0x3002, 0xA4FF,
+    0xA60E, 0xA60F, 0xA6F3, 0xA6F7, 0xA876, 0xA877, 0xA8CE, 0xA8CF, 0xA92F, 0xA9C8, 0xA9C9, 0xAA5D, 0xAA5E, 0xAA5F,
+    0xAAF0, 0xAAF1, 0xABEB, 0xFE52, 0xFE56, 0xFE57, 0xFF01, 0xFF0E, 0xFF1F, 0xFF61,
+};
 
-    ug::ssplit::SentenceStream segment_stream(
-        std::string_view{*plain},
-        SENTENCE_SPLITTER,
-        parameters.segment_split_mode
-    );
+static constexpr unsigned char utf8_lead_byte(const char32_t code_point) {
+    return code_point < 0x800
+               ? static_cast<unsigned char>(0xC0 | code_point >> 6)
+               : static_cast<unsigned char>(0xE0 | code_point >> 12);
+}
 
-    std::string_view segment_view;
-    while (segment_stream >> segment_view) {
-        std::vector<marian::string_view> token_ranges;
-        marian::Words segment_tokens = parameters.vocab->encodeWithByteRanges(
-            marian::string_view(segment_view.data(), segment_view.size()),
-            token_ranges,
-            false,
-            true
-        );
-        if (segment_tokens.empty()) {
+// ASCII sentence-final punctuation and line breaks, and the lead bytes of BOUNDARY_CODE_POINTS, which only make a
+// boundary possible: the whole character is then matched by is_boundary_candidate
+static constexpr std::array<bool, 256> BOUNDARY_BYTES = [] {
+    std::array<bool, 256> candidates{};
+    for (const unsigned char byte : {'.', '!', '?', '\n', '\r'}) {
+        candidates[byte] = true;
+    }
+    for (const char32_t code_point : BOUNDARY_CODE_POINTS) {
+        candidates[utf8_lead_byte(code_point)] = true;
+    }
+    return candidates;
+}();
+
+// Whether the character starting at `index` may end a segment. Only needs to be exact for the characters that ssplit
+// treats as boundaries: invalid UTF-8 is never a candidate
+static bool is_boundary_candidate(const std::string_view text, const size_t index) {
+    const auto byte = static_cast<unsigned char>(text[index]);
+    if (!BOUNDARY_BYTES[byte]) {
+        return false;
+    }
+    if (byte < 0x80) {
+        return true;
+    }
+    const size_t length = byte >= 0xE0 ? 3 : 2;
+    if (index + length > text.size()) {
+        return false;
+    }
+    char32_t code_point = byte & (length == 3 ? 0x0F : 0x1F);
+    for (size_t i = 1; i < length; i++) {
+        const auto continuation = static_cast<unsigned char>(text[index + i]);
+        if ((continuation & 0xC0) != 0x80) {
+            return false;
+        }
+        code_point = code_point << 6 | (continuation & 0x3F);
+    }
+    return std::binary_search(std::begin(BOUNDARY_CODE_POINTS), std::end(BOUNDARY_CODE_POINTS), code_point);
+}
+
+static bool has_boundary_candidate(const std::string_view text) {
+    size_t index = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    // Coarse filter 16 bytes at a time: any block with ASCII punctuation, line breaks or a non-ASCII lead byte is then
+    // checked character by character, such that text in other scripts only costs a lookup per character rather than
+    // the splitter's regexes, unless it actually contains a sentence terminal
+    const __m128i full_stop = _mm_set1_epi8('.');
+    const __m128i exclamation_mark = _mm_set1_epi8('!');
+    const __m128i question_mark = _mm_set1_epi8('?');
+    const __m128i line_feed = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    const __m128i lead_byte_min = _mm_set1_epi8(static_cast<char>(0xC2));
+    for (; index + 16 <= text.size(); index += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + index));
+        __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block, full_stop), _mm_cmpeq_epi8(block, exclamation_mark));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, question_mark));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, line_feed));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, carriage_return));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(_mm_max_epu8(block, lead_byte_min), block));
+        if (_mm_movemask_epi8(matches) == 0) {
             continue;
         }
+        for (size_t i = index; i < index + 16; i++) {
+            if (is_boundary_candidate(text, i)) {
+                return true;
+            }
+        }
+    }
+#endif
+    for (; index < text.size(); index++) {
+        if (is_boundary_candidate(text, index)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_ascii_space(const char byte) {
+    return byte == ' ' || byte == '\t' || byte == '\v' || byte == '\f';
+}
 
-        // We should generate segments of at most `max_segment_length` tokens, so they might need to be split
-        for (size_t segment_start = 0; segment_start < segment_tokens.size(); segment_start += parameters.max_segment_length) {
-            const size_t wrapped_segment_length = std::min(parameters.max_segment_length, segment_tokens.size() - segment_start);
+// Finds the single segment that ssplit would produce for the given text, or returns false if the text might contain
+// more than one segment and so needs the full splitter
+static bool find_single_segment(const std::string_view text, std::string_view& segment) {
+    if (has_boundary_candidate(text)) {
+        return false;
+    }
 
-            TokenizedSegment& wrapped_segment = tokenized_segments.emplace_back();
-            wrapped_segment.tokens.reserve(wrapped_segment_length);
-            for (size_t i = 0; i < wrapped_segment_length; i++) {
-                const size_t token_index = segment_start + i;
-                wrapped_segment.tokens.emplace_back(
-                    *plain,
-                    token_ranges[token_index],
-                    segment_tokens[token_index]
-                );
-            }
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && is_ascii_space(text[begin])) {
+        begin++;
+    }
+    while (end > begin && is_ascii_space(text[end - 1])) {
+        end--;
+    }
+    // ssplit also trims Unicode whitespace, which we don't try to recognize here
+    if (begin < end && (static_cast<unsigned char>(text[begin]) >= 0x80 || static_cast<unsigned char>(text[end - 1]) >= 0x80)) {
+        return false;
+    }
+
+    segment = text.substr(begin, end - begin);
+    return true;
+}
+
+static void tokenize_segment(const std::string& plain, const std::string_view segment_view, const TokenizationParameters& parameters, std::vector<TokenizedSegment>& tokenized_segments) {
+    std::vector<marian::string_view> token_ranges;
+    marian::Words segment_tokens = parameters.vocab->encodeWithByteRanges(
+        marian::string_view(segment_view.data(), segment_view.size()),
+        token_ranges,
+        false,
+        true
+    );
+    if (segment_tokens.empty()) {
+        return;
+    }
+
+    // We should generate segments of at most `max_segment_length` tokens, so they might need to be split
+    for (size_t segment_start = 0; segment_start < segment_tokens.size(); segment_start += parameters.max_segment_length) {
+        const size_t wrapped_segment_length = std::min(parameters.max_segment_length, segment_tokens.size() - segment_start);
+
+        TokenizedSegment& wrapped_segment = tokenized_segments.emplace_back();
+        wrapped_segment.continued = segment_start > 0;
+        wrapped_segment.tokens.reserve(wrapped_segment_length);
+        for (size_t i = 0; i < wrapped_segment_length; i++) {
+            const size_t token_index = segment_start + i;
+            wrapped_segment.tokens.emplace_back(
+                plain,
+                token_ranges[token_index],
+                segment_tokens[token_index]
+            );
+        }
+    }
+}
+
+std::shared_ptr<TokenizedString> tokenize(const std::shared_ptr<std::string>& plain, TokenizationParameters&& parameters) {
+    std::vector<TokenizedSegment> tokenized_segments;
+
+    std::string_view segment_view;
+    if (find_single_segment(*plain, segment_view)) {
+        // Most short messages have no sentence boundary at all, so we can avoid running the splitter's regexes
+        if (!segment_view.empty()) {
+            tokenize_segment(*plain, segment_view, parameters, tokenized_segments);
+        }
+    } else {
+        ug::ssplit::SentenceStream segment_stream(
+            std::string_view{*plain},
+            SENTENCE_SPLITTER,
+            parameters.segment_split_mode
+        );
+        while (segment_stream >> segment_view) {
+            tokenize_segment(*plain, segment_view, parameters, tokenized_segments);
         }
     }
 
@@ -76,29 +216,78 @@ std::shared_ptr<TokenizedString> tokenize(const std::shared_ptr<std::string>& pl
     );
 }
 
-std::shared_ptr<TokenizedString> decode_string(const std::shared_ptr<TokenizedString>& source, const std::shared_ptr<marian::Vocab const>& vocab, const std::shared_ptr<marian::History>* histories) {
-    std::string target_plain;
+std::shared_ptr<TokenizedString> decode_string(
+    const std::shared_ptr<TokenizedString>& source,
+    TokenizationParameters&& target_parameters,
+    const marian::Words* segment_words,
+    const std::vector<bool>* segment_truncated
+) {
+    const marian::Word eos_id = target_parameters.vocab->getEosId();
+
     std::vector<TokenizedSegment> target_segments;
-    target_plain.reserve(source->plain->size());
     target_segments.reserve(source->segments.size());
 
-    for (int i = 0; i < source->segments.size(); i++) {
-        const std::shared_ptr<marian::History>& history = histories[i];
+    for (size_t i = 0; i < source->segments.size(); i++) {
+        const marian::Words& tokens = segment_words[i];
+
+        // `tokens` contains an additional entry for the EOS marker, but we want to discard this
+        size_t token_count = tokens.size();
+        if (token_count > 0 && tokens[token_count - 1] == eos_id) {
+            token_count--;
+        }
+
+        TokenizedSegment& segment = target_segments.emplace_back();
+        segment.tokens.reserve(token_count);
+        for (size_t token_index = 0; token_index < token_count; token_index++) {
+            segment.tokens.emplace_back(tokens[token_index], 0, 0);
+        }
+        segment.truncated = segment_truncated && (*segment_truncated)[i];
+    }
 
-        const marian::NBestList results = history->nBest(1);
-        const marian::Words& tokens = std::get<0>(results[0]);
+    // Translations of translations share the gaps of the original text
+    std::shared_ptr<const std::vector<std::string>> gaps = source->gaps;
+    if (source->is_detokenized()) {
+        std::vector<std::string> source_gaps;
+        source_gaps.reserve(source->segments.size() + 1);
+        for (size_t i = 0; i <= source->segments.size(); i++) {
+            source_gaps.emplace_back(gap_before(*source, i));
+        }
+        gaps = std::make_shared<const std::vector<std::string>>(std::move(source_gaps));
+    }
+
+    return std::make_shared<TokenizedString>(
+        std::move(target_parameters),
+        std::move(target_segments),
+        std::move(gaps),
+        source
+    );
+}
+
+std::shared_ptr<TokenizedString> detokenize(const TokenizedString& string) {
+    const std::shared_ptr<marian::Vocab const>& vocab = string.parameters.vocab;
+
+    std::string target_plain;
+    std::vector<TokenizedSegment> target_segments;
+    target_segments.reserve(string.segments.size());
+
+    marian::Words tokens;
+    for (size_t i = 0; i < string.segments.size(); i++) {
+        tokens.clear();
+        for (const Token& token : string.segments[i].tokens) {
+            tokens.push_back(token.id);
+        }
 
         std::string plain_segment;
         std::vector<marian::string_view> token_ranges;
         vocab->decodeWithByteRanges(tokens, plain_segment, token_ranges, true);
 
         // Tokens between segments might not include the whitespace/punctuation, so we need to reinsert these
-        target_plain += gap_before(*source, i);
+        target_plain += gap_before(string, i);
 
-        // Note: `tokens` contains an additional entry for the EOS marker, but we want to discard this
-        const size_t token_count = token_ranges.size();
+        const size_t token_count = std::min(token_ranges.size(), tokens.size());
 
         TokenizedSegment& segment = target_segments.emplace_back();
+        segment.truncated = string.segments[i].truncated;
         segment.tokens.reserve(token_count);
         for (size_t token_index = 0; token_index < token_count; token_index++) {
             Token& token = segment.tokens.emplace_back(
@@ -113,20 +302,56 @@ std::shared_ptr<TokenizedString> decode_string(const std::shared_ptr<TokenizedSt
         target_plain += plain_segment;
     }
 
-    target_plain += gap_before(*source, source->segments.size());
+    target_plain += gap_before(string, string.segments.size());
 
     return std::make_shared<TokenizedString>(
-        TokenizationParameters{vocab, source->parameters.max_segment_length, source->parameters.segment_split_mode},
-        std::make_shared<std::string>(target_plain),
+        TokenizationParameters(string.parameters),
+        std::make_shared<std::string>(std::move(target_plain)),
         std::move(target_segments)
     );
 }
 
-std::shared_ptr<marian::data::CorpusBatch> generate_corpus_batch(const std::vector<std::shared_ptr<TokenizedString>>& batch, const std::shared_ptr<const marian::Vocab>& source_vocab) {
+bool has_source_segments(const TokenizedString& string) {
+    for (const TokenizedSegment& segment : string.segments) {
+        if (segment.tokens.empty() || segment.tokens.size() > string.parameters.max_segment_length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<TokenizedString> wrap_segments(const TokenizedString& string) {
+    assert(string.is_detokenized());
+    const size_t max_segment_length = string.parameters.max_segment_length;
+
+    std::vector<TokenizedSegment> wrapped_segments;
+    wrapped_segments.reserve(string.segments.size());
+    for (const TokenizedSegment& segment : string.segments) {
+        for (size_t segment_start = 0; segment_start < segment.tokens.size(); segment_start += max_segment_length) {
+            const size_t wrapped_segment_length = std::min(max_segment_length, segment.tokens.size() - segment_start);
+            TokenizedSegment& wrapped_segment = wrapped_segments.emplace_back();
+            wrapped_segment.continued = segment_start > 0;
+            wrapped_segment.tokens.assign(
+                segment.tokens.begin() + static_cast<ptrdiff_t>(segment_start),
+                segment.tokens.begin() + static_cast<ptrdiff_t>(segment_start + wrapped_segment_length)
+            );
+        }
+    }
+
+    return std::make_shared<TokenizedString>(
+        TokenizationParameters(string.parameters),
+        std::shared_ptr(string.plain),
+        std::move(wrapped_segments)
+    );
+}
+
+std::shared_ptr<marian::data::CorpusBatch> generate_corpus_batch(const std::vector<std::shared_ptr<TokenizedString>>& batch, const TokenizationParameters& source_parameters) {
+    const std::shared_ptr<const marian::Vocab>& source_vocab = source_parameters.vocab;
+
     size_t batch_size = 0;
     size_t max_segment_length = 0;
     for (const std::shared_ptr<TokenizedString>& source : batch) {
-        assert(source->parameters.vocab == source_vocab);
+        assert(!(source->parameters != source_parameters));
         for (const TokenizedSegment& segment : source->segments) {
             if (segment.tokens.size() > max_segment_length) {
                 max_segment_length = segment.tokens.size();
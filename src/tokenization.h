@@ -10,12 +10,15 @@ typedef ug::ssplit::SentenceStream::splitmode SsplitMode;
 SsplitMode parse_ssplit_mode(const std::string& mode);
 
 struct TokenizationParameters {
+    // Might be null if these parameters were deserialized, and have not yet been matched against a loaded vocabulary
     std::shared_ptr<marian::Vocab const> vocab;
+    // Identifies the contents of `vocab`, such that tokenization can be shared between separately loaded vocabularies
+    uint64_t vocab_fingerprint;
     size_t max_segment_length;
     SsplitMode segment_split_mode;
 
     bool operator!=(const TokenizationParameters& parameters) const {
-        return vocab != parameters.vocab
+        return vocab_fingerprint != parameters.vocab_fingerprint
                || max_segment_length != parameters.max_segment_length
                || segment_split_mode != parameters.segment_split_mode;
     }
@@ -34,16 +37,37 @@ struct Token {
        begin(token_view.data() - source.data()),
        end(token_view.data() - source.data() + token_view.length()) {
     }
+
+    explicit Token(
+        const marian::Word id,
+        const size_t begin,
+        const size_t end
+    ): id(id),
+       begin(begin),
+       end(end) {
+    }
 };
 
 struct TokenizedSegment {
     std::vector<Token> tokens;
+    // Set on translated segments whose decoding was cut short, as their output had degenerated
+    bool truncated = false;
+    // Set by tokenization on segments that continue the sentence of the previous segment, which was longer than
+    // max_segment_length and so wrapped
+    bool continued = false;
 };
 
 struct TokenizedString {
     const TokenizationParameters parameters;
+    // Null if this string was translated and has not been detokenized: tokens then only hold ids, without byte ranges
     const std::shared_ptr<std::string> plain;
     const std::vector<TokenizedSegment> segments;
+    // For strings that have not been detokenized, the text before each segment and after the last one, carried over
+    // from the string that they were translated from. Only the text is shared, such that a pivot chain does not keep
+    // every intermediate tokenization alive
+    const std::shared_ptr<const std::vector<std::string>> gaps;
+    // For translations, the tokenization that they were translated from, which is only used to identify it
+    const std::weak_ptr<const TokenizedString> translated_from;
 
     explicit TokenizedString(
         TokenizationParameters&& parameters,
@@ -53,12 +77,45 @@ struct TokenizedString {
        plain(std::move(plain)),
        segments(std::move(segments)) {
     }
+
+    explicit TokenizedString(
+        TokenizationParameters&& parameters,
+        std::vector<TokenizedSegment>&& segments,
+        std::shared_ptr<const std::vector<std::string>>&& gaps,
+        const std::shared_ptr<const TokenizedString>& translated_from
+    ): parameters(std::move(parameters)),
+       segments(std::move(segments)),
+       gaps(std::move(gaps)),
+       translated_from(translated_from) {
+    }
+
+    [[nodiscard]] bool is_detokenized() const {
+        return plain != nullptr;
+    }
 };
 
 std::shared_ptr<TokenizedString> tokenize(const std::shared_ptr<std::string>& plain, TokenizationParameters&& parameters);
 
-std::shared_ptr<marian::data::CorpusBatch> generate_corpus_batch(const std::vector<std::shared_ptr<TokenizedString>>& batch, const std::shared_ptr<const marian::Vocab>& source_vocab);
+std::shared_ptr<marian::data::CorpusBatch> generate_corpus_batch(const std::vector<std::shared_ptr<TokenizedString>>& batch, const TokenizationParameters& source_parameters);
+
+// Produces a string that only holds the translated token ids: the text is only decoded once `detokenize` is called.
+// `segment_truncated`, if given, holds whether each segment was cut short while decoding
+std::shared_ptr<TokenizedString> decode_string(
+    const std::shared_ptr<TokenizedString>& source,
+    TokenizationParameters&& target_parameters,
+    const marian::Words* segment_words,
+    const std::vector<bool>* segment_truncated = nullptr
+);
+
+// Decodes the text and byte ranges of a string produced by `decode_string`
+std::shared_ptr<TokenizedString> detokenize(const TokenizedString& string);
+
+// Whether every segment holds between 1 and max_segment_length tokens, as is needed to translate from the string.
+// Translations may not: their segments can be longer than their source's, or empty if only EOS was decoded
+bool has_source_segments(const TokenizedString& string);
 
-std::shared_ptr<TokenizedString> decode_string(const std::shared_ptr<TokenizedString>& source, const std::shared_ptr<marian::Vocab const>& vocab, const std::shared_ptr<marian::History>* histories);
+// Drops empty segments and wraps segments longer than max_segment_length, in the same way as `tokenize` would. The
+// string must have been detokenized, such that the gaps between segments are taken from its own text
+std::shared_ptr<TokenizedString> wrap_segments(const TokenizedString& string);
 
 #endif
@@ -1,12 +1,28 @@
 ﻿#include <translatador.h>
+#include "bisection.h"
+#include "bundle.h"
+#include "greedy_search.h"
+#include "serialization.h"
+#include "shortlist.h"
 #include "tokenization.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <common/options.h>
+#include <condition_variable>
 #include <data/types.h>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
 #include <marian.h>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <translator/beam_search.h>
 #include <utility>
 #include <vector>
@@ -16,6 +32,9 @@
 #ifdef __unix__
 #include <csignal>
 #endif
+#ifndef WASM_COMPATIBLE_SOURCE
+#include <intgemm/intgemm.h>
+#endif
 
 static std::mutex init_mutex;
 static bool initialized;
@@ -48,13 +67,15 @@ static void initialize() {
 struct OwnedBuffer {
     char* data;
     const size_t size;
+    // Memory owned by something else that outlives this buffer, such as a mapped model bundle
+    const bool borrowed = false;
 
     OwnedBuffer(const OwnedBuffer&) = delete;
 
     OwnedBuffer& operator=(const OwnedBuffer&) = delete;
 
     ~OwnedBuffer() {
-        if (data) {
+        if (data && !borrowed) {
 #ifdef _WIN32
             _aligned_free(data);
 #else
@@ -80,6 +101,14 @@ struct BufferRef {
         return data != buffer.data || size != buffer.size;
     }
 
+    [[nodiscard]] bool is_aligned(const size_t alignment) const {
+        return reinterpret_cast<uintptr_t>(data) % alignment == 0;
+    }
+
+    [[nodiscard]] OwnedBuffer borrow() const {
+        return OwnedBuffer{const_cast<char *>(data), size, true};
+    }
+
     [[nodiscard]] OwnedBuffer aligned_copy(const size_t alignment) const {
         if (data && size > 0) {
             const size_t aligned_size = (size + alignment - 1) / alignment * alignment;
@@ -98,12 +127,16 @@ struct BufferRef {
 struct Vocabs {
     std::shared_ptr<marian::Vocab> source;
     std::shared_ptr<marian::Vocab> target;
+    uint64_t source_fingerprint;
+    uint64_t target_fingerprint;
 
     explicit Vocabs(
         const std::shared_ptr<marian::Options>& options,
         const BufferRef buffer
     ): source(load_vocab(options, buffer)),
-       target(source) {
+       target(source),
+       source_fingerprint(fingerprint(buffer.data, buffer.size)),
+       target_fingerprint(source_fingerprint) {
     }
 
     explicit Vocabs(
@@ -111,41 +144,95 @@ struct Vocabs {
         const BufferRef source_buffer,
         const BufferRef target_buffer
     ): source(load_vocab(options, source_buffer)),
-       target(load_vocab(options, target_buffer)) {
+       target(load_vocab(options, target_buffer)),
+       source_fingerprint(fingerprint(source_buffer.data, source_buffer.size)),
+       target_fingerprint(fingerprint(target_buffer.data, target_buffer.size)) {
     }
 
     static std::shared_ptr<marian::Vocab> load_vocab(const std::shared_ptr<marian::Options>& options, const BufferRef buffer) {
-        const OwnedBuffer aligned_buffer = buffer.aligned_copy(64);
+        // The vocabulary is parsed rather than used in place, so we can always borrow it for the duration of loading
+        const OwnedBuffer aligned_buffer = buffer.is_aligned(64) ? buffer.borrow() : buffer.aligned_copy(64);
         std::shared_ptr<marian::Vocab> vocab = std::make_shared<marian::Vocab>(options, 0);
         vocab->loadFromSerialized(marian::string_view(aligned_buffer.data, aligned_buffer.size));
         return vocab;
     }
 };
 
+struct TranslationStats {
+    std::atomic<size_t> batches{0};
+    std::atomic<size_t> source_tokens{0};
+    std::atomic<size_t> target_tokens{0};
+
+    void record(const size_t source_token_count, const size_t target_token_count) {
+        batches.fetch_add(1, std::memory_order_relaxed);
+        source_tokens.fetch_add(source_token_count, std::memory_order_relaxed);
+        target_tokens.fetch_add(target_token_count, std::memory_order_relaxed);
+    }
+
+    void reset() {
+        batches.store(0, std::memory_order_relaxed);
+        source_tokens.store(0, std::memory_order_relaxed);
+        target_tokens.store(0, std::memory_order_relaxed);
+    }
+};
+
+static Vocabs create_vocabs(const std::shared_ptr<marian::Options>& options, const BufferRef source_vocab, const BufferRef target_vocab) {
+    if (source_vocab != target_vocab && target_vocab) {
+        return Vocabs(options, source_vocab, target_vocab);
+    }
+    return Vocabs(options, source_vocab);
+}
+
 struct ModelData {
+    // Optionally keeps memory alive that buffers are borrowed from, rather than copied
+    const std::shared_ptr<const void> backing;
     const std::shared_ptr<marian::Options> options;
     const OwnedBuffer model_memory;
-    // short_list_generator holds a raw reference to this memory
-    const OwnedBuffer short_list_memory;
     const Vocabs vocabs;
     const size_t max_segment_length;
     const SsplitMode segment_split_mode;
-    std::shared_ptr<marian::data::BinaryShortlistGenerator> short_list_generator;
+    const size_t beam_size;
+    // Source tokens per mini-batch that trl_translate splits batches into, or 0 to translate every batch whole
+    const size_t mini_batch_words;
+    // short_list_generator holds a raw reference to this memory
+    const OwnedBuffer short_list_memory;
+    ShortListStats short_list_stats;
+    TranslationStats translation_stats;
+    DegenerationStats degeneration_stats;
+    std::shared_ptr<TrackedShortListGenerator> short_list_generator;
+
+    [[nodiscard]] OwnedBuffer load_buffer(const BufferRef buffer, const size_t alignment) const {
+        if (backing && buffer.is_aligned(alignment)) {
+            return buffer.borrow();
+        }
+        return buffer.aligned_copy(alignment);
+    }
 
-    [[nodiscard]] Vocabs create_vocabs(const BufferRef source_vocab, const BufferRef target_vocab) const {
-        if (source_vocab != target_vocab && target_vocab) {
-            return Vocabs(options, source_vocab, target_vocab);
+    [[nodiscard]] OwnedBuffer load_short_list(const BufferRef short_list) const {
+        if (!short_list || is_binary_short_list(short_list.data, short_list.size)) {
+            return load_buffer(short_list, 64);
         }
-        return Vocabs(options, source_vocab);
+        // Otherwise we've been given a text lexical table, which we need to convert into the binary form
+        const std::string binary_short_list = build_short_list(
+            short_list.data, short_list.size,
+            *vocabs.source, vocabs.source_fingerprint,
+            *vocabs.target, vocabs.target_fingerprint,
+            ShortListParameters::parse(*options),
+            options->get<std::string>("shortlist-cache", "")
+        );
+        return BufferRef{binary_short_list.data(), binary_short_list.size()}.aligned_copy(64);
     }
 
-    [[nodiscard]] std::shared_ptr<marian::data::BinaryShortlistGenerator> create_short_list_generator() const {
+    [[nodiscard]] std::shared_ptr<TrackedShortListGenerator> create_short_list_generator() {
         if (short_list_memory) {
             bool shared = vocabs.source == vocabs.target;
-            return std::make_shared<marian::data::BinaryShortlistGenerator>(
-                short_list_memory.data, short_list_memory.size,
-                vocabs.source, vocabs.target,
-                0, 1, shared, false
+            return std::make_shared<TrackedShortListGenerator>(
+                std::make_shared<marian::data::BinaryShortlistGenerator>(
+                    short_list_memory.data, short_list_memory.size,
+                    vocabs.source, vocabs.target,
+                    0, 1, shared, false
+                ),
+                short_list_stats
             );
         }
         return {};
@@ -156,16 +243,29 @@ struct ModelData {
         const BufferRef model,
         const BufferRef source_vocab,
         const BufferRef target_vocab,
-        const BufferRef short_list
-    ): options(std::move(options)),
-       model_memory(model.aligned_copy(256)),
-       short_list_memory(short_list.aligned_copy(64)),
-       vocabs(create_vocabs(source_vocab, target_vocab)),
+        const BufferRef short_list,
+        std::shared_ptr<const void> backing = {}
+    ): backing(std::move(backing)),
+       options(std::move(options)),
+       model_memory(load_buffer(model, 256)),
+       vocabs(create_vocabs(this->options, source_vocab, target_vocab)),
        max_segment_length(this->options->get<size_t>("max-length-break")),
        segment_split_mode(parse_ssplit_mode(this->options->get<std::string>("ssplit-mode"))),
+       beam_size(this->options->get<size_t>("beam-size")),
+       mini_batch_words(this->options->get<size_t>("mini-batch-words", 0)),
+       short_list_memory(load_short_list(short_list)),
        short_list_generator(create_short_list_generator()) {
     }
 
+    [[nodiscard]] TokenizationParameters source_parameters() const {
+        return {vocabs.source, vocabs.source_fingerprint, max_segment_length, segment_split_mode};
+    }
+
+    [[nodiscard]] TokenizationParameters target_parameters(const TokenizationParameters& source) const {
+        // Translated strings are split in the same way as their source
+        return {vocabs.target, vocabs.target_fingerprint, source.max_segment_length, source.segment_split_mode};
+    }
+
     ModelData(const ModelData&) = delete;
 
     ModelData(const ModelData&& data) = delete;
@@ -182,31 +282,186 @@ struct ModelData {
     }
 };
 
+// Enough for one string to be fanned out to every model in a typical deployment, without growing unboundedly
+static constexpr size_t MAX_CACHED_TOKENIZATIONS = 8;
+
 struct TrlString {
-    const std::shared_ptr<std::string> plain;
+    // Entries are only ever prepended and never removed until the string is destroyed, so they can be read without locking
+    struct TokenizationCacheEntry {
+        const std::shared_ptr<TokenizedString> tokenized;
+        const TokenizationCacheEntry* const next;
+    };
+
+    // Translated strings are created without text: it is only decoded once required, through get_plain(), which may
+    // therefore throw. If decoding fails, it is attempted again on the next call
+    mutable std::shared_ptr<std::string> plain;
+    mutable std::once_flag plain_once;
+    // If this string was created without text, the tokenization that its text is decoded from, and the decoded result
+    const std::shared_ptr<TokenizedString> translated;
+    mutable std::shared_ptr<TokenizedString> detokenized;
 
+    mutable std::atomic<const TokenizationCacheEntry*> tokenized_head{nullptr};
+    // Only guards inserting into the cache
     mutable std::mutex tokenized_mutex;
-    mutable std::optional<std::shared_ptr<TokenizedString>> tokenized;
+    mutable size_t tokenized_count = 0;
 
-    explicit TrlString(std::string&& plain): plain(std::make_shared<std::string>(plain)) {
+    explicit TrlString(std::string&& plain): plain(std::make_shared<std::string>(std::move(plain))) {
+    }
+
+    explicit TrlString(std::shared_ptr<std::string>&& plain): plain(std::move(plain)) {
     }
 
     explicit TrlString(std::shared_ptr<TokenizedString>&& tokenized): plain(tokenized->plain),
-                                                                      tokenized(std::optional(std::move(tokenized))) {
+                                                                      translated(tokenized->is_detokenized() ? nullptr : tokenized),
+                                                                      tokenized_head(new TokenizationCacheEntry{std::move(tokenized), nullptr}),
+                                                                      tokenized_count(1) {
+    }
+
+    TrlString(const TrlString&) = delete;
+
+    TrlString& operator=(const TrlString&) = delete;
+
+    ~TrlString() {
+        const TokenizationCacheEntry* entry = tokenized_head.load(std::memory_order_acquire);
+        while (entry) {
+            const TokenizationCacheEntry* next = entry->next;
+            delete entry;
+            entry = next;
+        }
+    }
+
+    [[nodiscard]] const std::shared_ptr<std::string>& get_plain() const {
+        std::call_once(plain_once, [this] {
+            if (translated) {
+                detokenized = detokenize(*translated);
+                plain = detokenized->plain;
+            }
+        });
+        return plain;
     }
 
-    [[nodiscard]] std::shared_ptr<TokenizedString> get_tokenized(
-        const std::shared_ptr<marian::Vocab const>& vocab,
-        const size_t max_segment_length,
-        const SsplitMode split_mode
-    ) const {
+    [[nodiscard]] std::shared_ptr<TokenizedString> get_tokenized(TokenizationParameters&& parameters) const {
+        // A translated string whose target vocabulary matches is found here, and its ids are used without decoding them
+        if (std::shared_ptr<TokenizedString> cached = find_tokenized(parameters)) {
+            return as_source(std::move(cached));
+        }
+
+        std::shared_ptr<TokenizedString> unbound = find_unbound_tokenized(parameters);
+        // Deserialized tokenization only matches by fingerprint so far, which is much cheaper to bind than to retokenize
+        std::shared_ptr<TokenizedString> result = unbound
+                                                      ? bind_vocab(*unbound, std::move(parameters))
+                                                      : tokenize(get_plain(), std::move(parameters));
+
         std::lock_guard guard(tokenized_mutex);
-        TokenizationParameters parameters{vocab, max_segment_length, split_mode};
-        if (!tokenized.has_value() || tokenized.value()->parameters != parameters) {
-            // Could be wasteful if only vocabulary changed and not splitting mode - but this should be rare
-            tokenized.emplace(tokenize(plain, std::move(parameters)));
+        // Another thread may have got here first while we were tokenizing
+        if (std::shared_ptr<TokenizedString> cached = find_tokenized(result->parameters)) {
+            return as_source(std::move(cached));
+        }
+        if (tokenized_count < MAX_CACHED_TOKENIZATIONS) {
+            tokenized_head.store(new TokenizationCacheEntry{result, tokenized_head.load(std::memory_order_relaxed)}, std::memory_order_release);
+            tokenized_count++;
+        }
+        return as_source(std::move(result));
+    }
+
+    // Reused translations are split like their source, but their segments may be longer than max-length-break or empty,
+    // so those are wrapped as if the translation had been tokenized from its text. This is not cached, as it is rare
+    [[nodiscard]] std::shared_ptr<TokenizedString> as_source(std::shared_ptr<TokenizedString>&& tokenized) const {
+        if (has_source_segments(*tokenized)) {
+            return std::move(tokenized);
+        }
+        if (!tokenized->is_detokenized()) {
+            (void) get_plain();
+            return wrap_segments(*detokenized);
+        }
+        return wrap_segments(*tokenized);
+    }
+
+    // Returns the most recently cached tokenization with byte ranges, if any
+    [[nodiscard]] std::optional<std::shared_ptr<TokenizedString>> peek_tokenized() const {
+        const TokenizationCacheEntry* head = tokenized_head.load(std::memory_order_acquire);
+        if (!head) {
+            return std::nullopt;
+        }
+        if (!head->tokenized->is_detokenized()) {
+            (void) get_plain();
+            return detokenized;
+        }
+        return head->tokenized;
+    }
+
+    [[nodiscard]] std::shared_ptr<TokenizedString> find_tokenized(const TokenizationParameters& parameters) const {
+        for (const TokenizationCacheEntry* entry = tokenized_head.load(std::memory_order_acquire); entry; entry = entry->next) {
+            const TokenizationParameters& entry_parameters = entry->tokenized->parameters;
+            if (entry_parameters.vocab && !(entry_parameters != parameters)) {
+                return entry->tokenized;
+            }
+        }
+        return {};
+    }
+
+    [[nodiscard]] std::shared_ptr<TokenizedString> find_unbound_tokenized(const TokenizationParameters& parameters) const {
+        for (const TokenizationCacheEntry* entry = tokenized_head.load(std::memory_order_acquire); entry; entry = entry->next) {
+            const TokenizationParameters& entry_parameters = entry->tokenized->parameters;
+            if (!entry_parameters.vocab && !(entry_parameters != parameters)) {
+                return entry->tokenized;
+            }
+        }
+        return {};
+    }
+};
+
+// A thread kept for the lifetime of a model, so that work can be handed to the model from another thread without
+// starting and joining a new thread every time
+class ModelWorker {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::packaged_task<void()>> tasks;
+    bool stopping = false;
+    std::thread thread;
+
+    void run() {
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    ModelWorker(): thread([this] { run(); }) {
+    }
+
+    ModelWorker(const ModelWorker&) = delete;
+
+    ModelWorker& operator=(const ModelWorker&) = delete;
+
+    ~ModelWorker() {
+        {
+            std::lock_guard guard(mutex);
+            stopping = true;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+
+    [[nodiscard]] std::future<void> submit(std::function<void()>&& function) {
+        std::packaged_task<void()> task(std::move(function));
+        std::future<void> result = task.get_future();
+        {
+            std::lock_guard guard(mutex);
+            tasks.push_back(std::move(task));
         }
-        return tokenized.value();
+        condition.notify_one();
+        return result;
     }
 };
 
@@ -214,6 +469,8 @@ struct TrlModel {
     const std::shared_ptr<ModelData> data;
     const std::shared_ptr<marian::ExpressionGraph> graph;
     const std::vector<std::shared_ptr<marian::Scorer>> scorers;
+    // Started on first use by trl_translate_sharded, and joined before the rest of the model is destroyed
+    mutable std::unique_ptr<ModelWorker> worker;
 
     TrlModel(
         std::shared_ptr<ModelData> data,
@@ -228,8 +485,21 @@ struct TrlModel {
 
     TrlModel& operator=(const TrlModel&) = delete;
 
+    // A model is only used by one thread at a time, so this needs no synchronization
+    [[nodiscard]] ModelWorker& get_worker() const {
+        if (!worker) {
+            worker = std::make_unique<ModelWorker>();
+        }
+        return *worker;
+    }
+
+    // Returns the best translation of every segment in the batch, in batch order
+    [[nodiscard]] SearchResult search(const std::shared_ptr<marian::data::CorpusBatch>& batch, const CancellationCheck& cancelled = {}) const;
+
+    // Translates the batch in mini-batches of up to mini_batch_words source tokens, or whole if 0. Strings for which
+    // `cancelled` returns true are passed to the handler as null
     template<typename F>
-    void evaluate(const std::vector<std::shared_ptr<TokenizedString>>&& batch, F handler) const;
+    void evaluate(const std::vector<std::shared_ptr<TokenizedString>>&& batch, size_t mini_batch_words, F handler, const CancellationCheck& cancelled = {}) const;
 };
 
 char* trl_get_last_error() {
@@ -241,6 +511,10 @@ char* trl_get_last_error() {
     return nullptr;
 }
 
+const char* trl_peek_last_error() {
+    return last_error.empty() ? nullptr : last_error.c_str();
+}
+
 template<typename T, typename F>
 static T* create_fallible(const F function) {
     try {
@@ -262,7 +536,7 @@ static TrlError run_fallible(const F function) {
     }
 }
 
-static std::shared_ptr<marian::Options> parse_options(const char* yaml) {
+static std::shared_ptr<marian::Options> parse_options(const char* yaml, const char* override_yaml = nullptr) {
     std::shared_ptr<marian::Options> options = std::make_shared<marian::Options>();
 
     const marian::ConfigParser parser(marian::cli::mode::translation);
@@ -285,6 +559,9 @@ static std::shared_ptr<marian::Options> parse_options(const char* yaml) {
     if (yaml) {
         options->parse(std::string(yaml));
     }
+    if (override_yaml) {
+        options->parse(std::string(override_yaml));
+    }
 
     // Dummy values, should not be overridden
     options->set<std::vector<std::string>>("vocabs", {"source", "target"});
@@ -292,13 +569,13 @@ static std::shared_ptr<marian::Options> parse_options(const char* yaml) {
     return options;
 }
 
-static TrlModel instantiate_model(const std::shared_ptr<ModelData>& data) {
+static TrlModel instantiate_model(const std::shared_ptr<ModelData>& data, const size_t workspace_mb) {
     const marian::DeviceId device(0, marian::DeviceType::cpu);
     std::shared_ptr<marian::ExpressionGraph> graph = std::make_shared<marian::ExpressionGraph>(true);
     graph->setDefaultElementType(marian::typeFromString(data->options->get<std::vector<std::string>>("precision", {"float32"})[0]));
     graph->setDevice(device);
     graph->getBackend()->configureDevice(data->options);
-    graph->reserveWorkspaceMB(data->options->get<size_t>("workspace"));
+    graph->reserveWorkspaceMB(workspace_mb);
 
     std::vector<std::shared_ptr<marian::Scorer>> scorers = marian::createScorers(data->options, std::vector<const void *>{data->model_memory.data});
     for (const std::shared_ptr<marian::Scorer>& scorer : scorers) {
@@ -313,6 +590,21 @@ static TrlModel instantiate_model(const std::shared_ptr<ModelData>& data) {
     return {data, std::move(graph), std::move(scorers)};
 }
 
+static double warmup_model(const TrlModel& model, const TrlWarmupOptions* options);
+
+static TrlModel* create_model(const std::shared_ptr<ModelData>& data) {
+    auto* model = new TrlModel(instantiate_model(data, data->options->get<size_t>("workspace")));
+    if (data->options->get<bool>("warmup", false)) {
+        try {
+            warmup_model(*model, nullptr);
+        } catch (...) {
+            delete model;
+            throw;
+        }
+    }
+    return model;
+}
+
 const TrlModel* trl_create_model(const char* yaml_config, const char* model, const size_t model_size, const char* source_vocab, const size_t source_vocab_size, const char* target_vocab, const size_t target_vocab_size, const char* short_list, const size_t short_list_size) {
     initialize();
     return create_fallible<TrlModel>([=] {
@@ -324,13 +616,83 @@ const TrlModel* trl_create_model(const char* yaml_config, const char* model, con
             BufferRef{target_vocab, target_vocab_size},
             BufferRef{short_list, short_list_size}
         );
-        return new TrlModel(instantiate_model(data));
+        return create_model(data);
+    });
+}
+
+TrlError trl_pack_bundle(const char* path, const char* yaml_config, const char* model, const size_t model_size, const char* source_vocab, const size_t source_vocab_size, const char* target_vocab, const size_t target_vocab_size, const char* short_list, const size_t short_list_size, const char* cpu) {
+    initialize();
+    return run_fallible([=] {
+        // Parse now so that we can't produce a bundle that would fail to load
+        const std::shared_ptr<marian::Options> options = parse_options(yaml_config);
+
+        const BufferRef source_vocab_buffer{source_vocab, source_vocab_size};
+        const BufferRef target_vocab_buffer{target_vocab, target_vocab_size};
+        const bool shared_vocab = !target_vocab_buffer || !(source_vocab_buffer != target_vocab_buffer);
+
+        // Bundles should load as fast as possible, so we convert text lexical tables ahead of time
+        std::string binary_short_list;
+        std::string_view short_list_section(short_list ? short_list : "", short_list_size);
+        if (short_list_size > 0 && !is_binary_short_list(short_list, short_list_size)) {
+            const Vocabs vocabs = create_vocabs(options, source_vocab_buffer, target_vocab_buffer);
+            binary_short_list = build_short_list(
+                short_list, short_list_size,
+                *vocabs.source, vocabs.source_fingerprint,
+                *vocabs.target, vocabs.target_fingerprint,
+                ShortListParameters::parse(*options),
+                ""
+            );
+            short_list_section = binary_short_list;
+        }
+
+        const BundleSections sections{
+            yaml_config ? std::string_view(yaml_config) : std::string_view(),
+            std::string_view(model, model_size),
+            std::string_view(source_vocab, source_vocab_size),
+            shared_vocab ? std::string_view() : std::string_view(target_vocab, target_vocab_size),
+            short_list_section
+        };
+        write_bundle(path, sections, cpu ? cpu : current_cpu_tag(), options->get<std::string>("gemm-precision"));
+    });
+}
+
+const TrlModel* trl_create_model_from_bundle(const char* path, const char* yaml_config, const int verify_checksums) {
+    initialize();
+    return create_fallible<TrlModel>([=] {
+        Bundle bundle = open_bundle(path, verify_checksums != 0);
+        if (bundle.cpu != current_cpu_tag()) {
+            throw std::runtime_error("Model bundle was packed for " + bundle.cpu + ", but this is " + current_cpu_tag());
+        }
+
+        const std::string bundle_config(bundle.sections.config);
+        std::shared_ptr<marian::Options> options = parse_options(bundle_config.empty() ? nullptr : bundle_config.c_str(), yaml_config);
+        const std::string precision = options->get<std::string>("gemm-precision");
+        if (!bundle.precision.empty() && precision != bundle.precision) {
+            throw std::runtime_error("Model bundle was packed for gemm-precision " + bundle.precision + ", but " + precision + " was configured");
+        }
+
+        const BundleSections& sections = bundle.sections;
+        const std::shared_ptr<ModelData> data = std::make_shared<ModelData>(
+            options,
+            BufferRef{sections.model.data(), sections.model.size()},
+            BufferRef{sections.source_vocab.data(), sections.source_vocab.size()},
+            BufferRef{sections.target_vocab.data(), sections.target_vocab.size()},
+            BufferRef{sections.short_list.data(), sections.short_list.size()},
+            std::move(bundle.file)
+        );
+        return create_model(data);
     });
 }
 
+static TrlModel* clone_model(const TrlModel& model) {
+    return create_model(model.data);
+}
+
 const TrlModel* trl_clone_model(const TrlModel* model) {
-    // We already initialized `model`, so we should hope that this should not fail
-    return new TrlModel(instantiate_model(model->data));
+    // We already initialized `model`, so we should hope that this should not fail - but warmup might
+    return create_fallible<TrlModel>([model] {
+        return clone_model(*model);
+    });
 }
 
 void trl_destroy_model(const TrlModel* model) {
@@ -341,50 +703,1696 @@ const TrlString* trl_create_string(const char* utf) {
     return new TrlString(std::string(utf));
 }
 
+const TrlString* trl_create_string_n(const char* utf, const size_t size) {
+    return new TrlString(std::string(utf, size));
+}
+
 const char* trl_get_string_utf(const TrlString* string) {
-    return string->plain->c_str();
+    // Translations are only decoded here, which can fail
+    return create_fallible<const char>([string] {
+        return string->get_plain()->c_str();
+    });
+}
+
+size_t trl_get_string_size(const TrlString* string) {
+    try {
+        return string->get_plain()->size();
+    } catch (std::exception& e) {
+        last_error = std::string(e.what());
+        return 0;
+    }
+}
+
+int trl_is_string_truncated(const TrlString* string) {
+    // Covers both translations and deserialized translations, as tokenizations of plain text are never truncated
+    for (auto entry = string->tokenized_head.load(std::memory_order_acquire); entry; entry = entry->next) {
+        const std::vector<TokenizedSegment>& segments = entry->tokenized->segments;
+        const bool truncated = std::any_of(segments.begin(), segments.end(), [](const TokenizedSegment& segment) {
+            return segment.truncated;
+        });
+        if (truncated) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 void trl_destroy_string(const TrlString* string) {
     delete string;
 }
 
-template<typename F>
-void TrlModel::evaluate(const std::vector<std::shared_ptr<TokenizedString>>&& batch, const F handler) const {
-    const std::shared_ptr<marian::data::CorpusBatch> corpus_batch = generate_corpus_batch(batch, data->vocabs.source);
+TrlError trl_tokenize_string(const TrlModel* model, const TrlString* string) {
+    return run_fallible([model, string] {
+        (void) string->get_tokenized(model->data->source_parameters());
+    });
+}
+
+TrlError trl_serialize_string(const TrlString* string, char** data, size_t* size) {
+    return run_fallible([string, data, size] {
+        const std::optional<std::shared_ptr<TokenizedString>> tokenized = string->peek_tokenized();
+        const TokenizedString* tokenized_ptr = tokenized.has_value() ? tokenized.value().get() : nullptr;
 
-    const std::shared_ptr<marian::Vocab const> target_vocab = data->vocabs.target;
-    marian::BeamSearch search(data->options, scorers, target_vocab);
-    const marian::Histories histories = search.search(graph, corpus_batch);
+        const std::string& plain = *string->get_plain();
+        const size_t result_size = serialized_size(plain, tokenized_ptr);
+        char* result = static_cast<char *>(std::malloc(result_size));
+        if (!result) {
+            throw std::bad_alloc();
+        }
+        serialize_string(plain, tokenized_ptr, result);
+
+        *data = result;
+        *size = result_size;
+    });
+}
+
+const TrlString* trl_deserialize_string(const char* data, const size_t size) {
+    return create_fallible<TrlString>([data, size] {
+        DeserializedString string = deserialize_string(data, size);
+        if (string.tokenized) {
+            return new TrlString(std::move(string.tokenized));
+        }
+        return new TrlString(std::move(string.plain));
+    });
+}
+
+SearchResult TrlModel::search(const std::shared_ptr<marian::data::CorpusBatch>& batch, const CancellationCheck& cancelled) const {
+    if (data->beam_size == 1) {
+        // Skip the beam and history bookkeeping entirely when we only ever keep the single best word
+        const GreedySearch search(data->options, scorers, data->vocabs.target, data->degeneration_stats);
+        return search.search(graph, batch, cancelled);
+    }
+
+    // Marian's beam search cannot be interrupted between steps, so cancellation is only checked before it starts
+    if (cancelled) {
+        bool all_cancelled = true;
+        for (size_t sentence = 0; sentence < batch->size() && all_cancelled; sentence++) {
+            all_cancelled = cancelled(sentence);
+        }
+        if (all_cancelled) {
+            return {std::vector<marian::Words>(batch->size()), std::vector<bool>(batch->size(), false)};
+        }
+    }
+
+    marian::BeamSearch search(data->options, scorers, data->vocabs.target);
+    const marian::Histories histories = search.search(graph, batch);
+
+    // Nor can hypotheses be cut short while searching, so the limits are only applied once to the end of the best
+    // hypothesis after the search has finished. This saves no decoding time at all: it only trims output that was still
+    // looping or too long when the search stopped
+    const DegenerationLimits limits = DegenerationLimits::parse(*data->options);
+    const std::vector<SourceProfile> sources = limits.profile_sources(batch);
+    const marian::Word eos_id = data->vocabs.target->getEosId();
 
-    size_t segment_id = 0;
+    SearchResult result;
+    result.words.reserve(histories.size());
+    result.truncated.reserve(histories.size());
+    for (size_t sentence = 0; sentence < histories.size(); sentence++) {
+        marian::Words words = std::get<0>(histories[sentence]->nBest(1)[0]);
+        const size_t length = !words.empty() && words.back() == eos_id ? words.size() - 1 : words.size();
+        const std::optional<size_t> truncated_length = limits.find_truncation(words.data(), length, sources[sentence], data->degeneration_stats);
+        const bool truncated = truncated_length.has_value();
+        if (truncated) {
+            words.resize(*truncated_length);
+            words.push_back(eos_id);
+        }
+        result.words.push_back(std::move(words));
+        result.truncated.push_back(truncated);
+    }
+    return result;
+}
+
+static size_t count_tokens(const TokenizedString& string) {
+    size_t token_count = 0;
+    for (const TokenizedSegment& segment : string.segments) {
+        // Every segment is also terminated by EOS
+        token_count += segment.tokens.size() + 1;
+    }
+    return token_count;
+}
+
+// Splits the batch into contiguous mini-batches of up to mini_batch_words tokens, returning the index that each mini-batch
+// begins at followed by the batch size. Strings above the budget are placed in a mini-batch of their own
+static std::vector<size_t> split_by_mini_batch_words(const std::vector<std::shared_ptr<TokenizedString>>& batch, const size_t mini_batch_words) {
+    std::vector<size_t> begins{0};
+    size_t token_count = 0;
     for (size_t i = 0; i < batch.size(); i++) {
-        const std::shared_ptr<TokenizedString>& source = batch[i];
-        std::shared_ptr<TokenizedString> target = decode_string(source, target_vocab, &histories[segment_id]);
-        segment_id += source->segments.size();
+        const size_t string_token_count = count_tokens(*batch[i]);
+        if (i > begins.back() && token_count + string_token_count > mini_batch_words) {
+            begins.push_back(i);
+            token_count = 0;
+        }
+        token_count += string_token_count;
+    }
+    begins.push_back(batch.size());
+    return begins;
+}
+
+template<typename F>
+void TrlModel::evaluate(const std::vector<std::shared_ptr<TokenizedString>>&& batch, const size_t mini_batch_words, const F handler, const CancellationCheck& cancelled) const {
+    if (batch.empty()) {
+        return;
+    }
+    const std::vector<size_t> begins = mini_batch_words > 0 ? split_by_mini_batch_words(batch, mini_batch_words) : std::vector<size_t>{0, batch.size()};
+    for (size_t mini_batch = 0; mini_batch + 1 < begins.size(); mini_batch++) {
+        const size_t begin = begins[mini_batch];
+        const size_t end = begins[mini_batch + 1];
+        const std::vector<std::shared_ptr<TokenizedString>> strings(batch.begin() + begin, batch.begin() + end);
+
+        // Strings may have been split differently than this model would, such as while tuning max-length-break
+        const std::shared_ptr<marian::data::CorpusBatch> corpus_batch = generate_corpus_batch(strings, strings.front()->parameters);
+
+        CancellationCheck segment_cancelled;
+        if (cancelled) {
+            std::vector<size_t> segment_strings;
+            for (size_t i = 0; i < strings.size(); i++) {
+                segment_strings.insert(segment_strings.end(), strings[i]->segments.size(), begin + i);
+            }
+            segment_cancelled = [&cancelled, segment_strings = std::move(segment_strings)](const size_t segment) {
+                return cancelled(segment_strings[segment]);
+            };
+        }
+        const SearchResult result = search(corpus_batch, segment_cancelled);
+        const std::vector<marian::Words>& segment_words = result.words;
 
-        handler(i, std::move(target));
+        size_t target_token_count = 0;
+        for (const marian::Words& words : segment_words) {
+            target_token_count += words.size();
+        }
+        data->translation_stats.record(corpus_batch->front()->batchWords(), target_token_count);
+
+        size_t segment_id = 0;
+        for (size_t i = 0; i < strings.size(); i++) {
+            const std::shared_ptr<TokenizedString>& source = strings[i];
+            const size_t segment_count = source->segments.size();
+            // Finished segments always hold at least EOS, so an empty one was cancelled before it completed
+            const bool completed = std::none_of(segment_words.begin() + segment_id, segment_words.begin() + segment_id + segment_count, [](const marian::Words& words) {
+                return words.empty();
+            });
+            const std::vector<bool> segment_truncated(result.truncated.begin() + segment_id, result.truncated.begin() + segment_id + segment_count);
+            std::shared_ptr<TokenizedString> target = completed ? decode_string(source, data->target_parameters(source->parameters), &segment_words[segment_id], &segment_truncated) : nullptr;
+            segment_id += segment_count;
+
+            handler(begin + i, std::move(target));
+        }
     }
 }
 
 TrlError trl_translate(const TrlModel* model, const TrlString* const* source, const TrlString** target, const size_t count) {
     return run_fallible([model, source, target, count] {
-        const std::shared_ptr<const marian::Vocab> source_vocab = model->data->vocabs.source;
-        const size_t max_segment_length = model->data->max_segment_length;
-        const SsplitMode segment_split_mode = model->data->segment_split_mode;
-
         std::vector<std::shared_ptr<TokenizedString>> batch;
         batch.reserve(count);
         for (size_t i = 0; i < count; i++) {
-            batch.push_back(source[i]->get_tokenized(source_vocab, max_segment_length, segment_split_mode));
+            batch.push_back(source[i]->get_tokenized(model->data->source_parameters()));
         }
 
-        model->evaluate(std::move(batch), [&target](const int i, std::shared_ptr<TokenizedString>&& string) {
+        model->evaluate(std::move(batch), model->data->mini_batch_words, [&target](const size_t i, std::shared_ptr<TokenizedString>&& string) {
             target[i] = new TrlString(std::move(string));
         });
     });
 }
 
+// Translates the strings in [begin, end), halving the range on failure until the strings that fail are isolated. Strings
+// translated by mini-batches that succeeded before a failure are kept, and not translated again
+static void translate_bisecting(
+    const TrlModel& model,
+    const std::vector<std::shared_ptr<TokenizedString>>& batch,
+    const size_t begin,
+    const size_t end,
+    std::vector<std::shared_ptr<TokenizedString>>& results,
+    std::vector<std::string>& errors,
+    const CancellationCheck& cancelled = {}
+) {
+    run_bisecting(begin, end, results, errors, [&](const size_t range_begin, const size_t range_end) {
+        std::vector<std::shared_ptr<TokenizedString>> strings(batch.begin() + range_begin, batch.begin() + range_end);
+        CancellationCheck range_cancelled;
+        if (cancelled) {
+            range_cancelled = [&cancelled, range_begin](const size_t i) {
+                return cancelled(range_begin + i);
+            };
+        }
+        model.evaluate(std::move(strings), model.data->mini_batch_words, [&results, &errors, range_begin](const size_t i, std::shared_ptr<TokenizedString>&& string) {
+            if (string) {
+                results[range_begin + i] = std::move(string);
+            } else {
+                errors[range_begin + i] = "Translation was cancelled";
+            }
+        }, range_cancelled);
+    });
+}
+
+TrlError trl_translate_each(const TrlModel* model, const TrlString* const* source, const TrlString** target, TrlError* statuses, const size_t count) {
+    return run_fallible([model, source, target, statuses, count] {
+        std::vector<std::shared_ptr<TokenizedString>> batch;
+        std::vector<size_t> batch_indices;
+        std::vector<std::string> errors(count);
+        batch.reserve(count);
+        batch_indices.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            try {
+                batch.push_back(source[i]->get_tokenized(model->data->source_parameters()));
+                batch_indices.push_back(i);
+            } catch (std::exception& e) {
+                errors[i] = e.what();
+            }
+        }
+
+        std::vector<std::shared_ptr<TokenizedString>> results(batch.size());
+        std::vector<std::string> batch_errors(batch.size());
+        if (!batch.empty()) {
+            translate_bisecting(*model, batch, 0, batch.size(), results, batch_errors);
+        }
+
+        size_t failed_count = count - batch.size();
+        std::vector<std::shared_ptr<TokenizedString>> targets(count);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (results[i]) {
+                targets[batch_indices[i]] = std::move(results[i]);
+            } else {
+                errors[batch_indices[i]] = std::move(batch_errors[i]);
+                failed_count++;
+            }
+        }
+
+        const std::string* first_error = nullptr;
+        for (size_t i = 0; i < count; i++) {
+            if (targets[i]) {
+                target[i] = new TrlString(std::move(targets[i]));
+            } else {
+                target[i] = nullptr;
+                first_error = first_error ? first_error : &errors[i];
+            }
+            if (statuses) {
+                statuses[i] = target[i] ? TRL_OK : TRL_ERROR;
+            }
+        }
+
+        if (first_error) {
+            throw std::runtime_error("Failed to translate " + std::to_string(failed_count) + " of " + std::to_string(count) + " strings: " + *first_error);
+        }
+    });
+}
+
+static std::vector<marian::IndexType> segment_ids(const TokenizedSegment& segment) {
+    std::vector<marian::IndexType> ids;
+    ids.reserve(segment.tokens.size());
+    for (const Token& token : segment.tokens) {
+        ids.push_back(token.id.toWordIndex());
+    }
+    return ids;
+}
+
+TrlError trl_retranslate(const TrlModel* model, const TrlString* previous_source, const TrlString* previous_target, const TrlString* source, const TrlString** target) {
+    return run_fallible([model, previous_source, previous_target, source, target] {
+        const ModelData& data = *model->data;
+        const std::shared_ptr<TokenizedString> tokenized = source->get_tokenized(data.source_parameters());
+        const std::shared_ptr<TokenizedString> previous_tokenized = previous_source->get_tokenized(data.source_parameters());
+        // Only a translation of exactly this tokenization into this model's target vocabulary can be reused: anything
+        // else, such as a target that was edited, deserialized or translated by another model, is translated again
+        const std::shared_ptr<TokenizedString>& previous_translated = previous_target->translated;
+        const bool reusable = previous_translated
+                              && previous_translated->translated_from.lock() == previous_tokenized
+                              && !(previous_translated->parameters != data.target_parameters(previous_tokenized->parameters));
+
+        // Segments are matched by content rather than position, so that inserting or removing a sentence reuses the rest
+        std::map<std::vector<marian::IndexType>, size_t> previous_segments;
+        if (reusable) {
+            for (size_t i = 0; i < previous_tokenized->segments.size(); i++) {
+                previous_segments.emplace(segment_ids(previous_tokenized->segments[i]), i);
+            }
+        }
+
+        std::vector<marian::Words> segment_words(tokenized->segments.size());
+        std::vector<bool> segment_truncated(tokenized->segments.size(), false);
+        std::vector<size_t> changed_indices;
+        std::vector<TokenizedSegment> changed_segments;
+        for (size_t i = 0; i < tokenized->segments.size(); i++) {
+            const auto previous = previous_segments.find(segment_ids(tokenized->segments[i]));
+            if (previous != previous_segments.end()) {
+                const TokenizedSegment& previous_segment = previous_translated->segments[previous->second];
+                for (const Token& token : previous_segment.tokens) {
+                    segment_words[i].push_back(token.id);
+                }
+                segment_truncated[i] = previous_segment.truncated;
+            } else {
+                changed_indices.push_back(i);
+                changed_segments.push_back(tokenized->segments[i]);
+            }
+        }
+
+        if (!changed_segments.empty()) {
+            std::vector<std::shared_ptr<TokenizedString>> batch{
+                std::make_shared<TokenizedString>(
+                    TokenizationParameters(tokenized->parameters),
+                    std::shared_ptr<std::string>(tokenized->plain),
+                    std::move(changed_segments)
+                )
+            };
+            model->evaluate(std::move(batch), data.mini_batch_words, [&segment_words, &segment_truncated, &changed_indices](size_t, std::shared_ptr<TokenizedString>&& translated) {
+                for (size_t i = 0; i < changed_indices.size(); i++) {
+                    marian::Words& words = segment_words[changed_indices[i]];
+                    for (const Token& token : translated->segments[i].tokens) {
+                        words.push_back(token.id);
+                    }
+                    segment_truncated[changed_indices[i]] = translated->segments[i].truncated;
+                }
+            });
+        }
+
+        *target = new TrlString(decode_string(tokenized, data.target_parameters(tokenized->parameters), segment_words.data(), &segment_truncated));
+    });
+}
+
+// Spread over short messages up to full-length segments, as the workspace needs to grow for the longest of these
+static constexpr size_t DEFAULT_WARMUP_SEGMENT_LENGTHS[] = {4, 16, 48, 128};
+static constexpr size_t DEFAULT_WARMUP_BATCH_SIZE = 8;
+
+static std::shared_ptr<TokenizedString> create_warmup_string(const ModelData& data, const size_t length, const size_t seed) {
+    const marian::Vocab& vocab = *data.vocabs.source;
+    const size_t vocab_size = vocab.size();
+
+    TokenizedSegment segment;
+    segment.tokens.reserve(length);
+    for (size_t i = 0; i < length; i++) {
+        // Spread the ids over the vocabulary, so that a representative set of embeddings and short list entries is touched
+        size_t index = (seed + i) * 7919 % vocab_size;
+        while (marian::Word::fromWordIndex(index) == vocab.getEosId() || marian::Word::fromWordIndex(index) == vocab.getUnkId()) {
+            index = (index + 1) % vocab_size;
+        }
+        // Synthetic tokens have no text: this only affects the decoded string, which we discard
+        segment.tokens.emplace_back(marian::Word::fromWordIndex(index), 0, 0);
+    }
+
+    std::vector<TokenizedSegment> segments;
+    segments.push_back(std::move(segment));
+    return std::make_shared<TokenizedString>(data.source_parameters(), std::make_shared<std::string>(), std::move(segments));
+}
+
+static double warmup_model(const TrlModel& model, const TrlWarmupOptions* options) {
+    const ModelData& data = *model.data;
+
+    std::vector<size_t> segment_lengths;
+    if (options && options->segment_lengths) {
+        segment_lengths.assign(options->segment_lengths, options->segment_lengths + options->segment_length_count);
+    } else {
+        segment_lengths.assign(std::begin(DEFAULT_WARMUP_SEGMENT_LENGTHS), std::end(DEFAULT_WARMUP_SEGMENT_LENGTHS));
+    }
+    const size_t batch_size = options && options->batch_size > 0 ? options->batch_size : DEFAULT_WARMUP_BATCH_SIZE;
+    const size_t iterations = options && options->iterations > 0 ? options->iterations : 1;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (const size_t requested_length : segment_lengths) {
+            // Longer segments would never be produced by tokenization
+            const size_t length = std::max<size_t>(1, std::min(requested_length, data.max_segment_length));
+
+            std::vector<std::shared_ptr<TokenizedString>> batch;
+            batch.reserve(batch_size);
+            for (size_t i = 0; i < batch_size; i++) {
+                batch.push_back(create_warmup_string(data, length, (iteration * batch_size + i) * length));
+            }
+            model.evaluate(std::move(batch), data.mini_batch_words, [](size_t, std::shared_ptr<TokenizedString>&&) {
+            });
+        }
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TrlError trl_warmup_model(const TrlModel* model, const TrlWarmupOptions* options, double* duration_ms) {
+    return run_fallible([model, options, duration_ms] {
+        const double duration = warmup_model(*model, options);
+        if (duration_ms) {
+            *duration_ms = duration;
+        }
+    });
+}
+
+// Splits the batch into contiguous shards of roughly equal token counts, returning the index that each shard begins at
+static std::vector<size_t> split_by_token_budget(const std::vector<std::shared_ptr<TokenizedString>>& batch, const size_t shard_count) {
+    std::vector<size_t> token_offsets(batch.size() + 1, 0);
+    for (size_t i = 0; i < batch.size(); i++) {
+        token_offsets[i + 1] = token_offsets[i] + count_tokens(*batch[i]);
+    }
+
+    std::vector<size_t> shard_begins(shard_count + 1, batch.size());
+    shard_begins[0] = 0;
+    size_t index = 0;
+    for (size_t shard = 1; shard < shard_count; shard++) {
+        const size_t token_target = token_offsets.back() * shard / shard_count;
+        // Leave at least one string for this shard and every shard after it
+        const size_t min_index = shard_begins[shard - 1] + 1;
+        const size_t max_index = batch.size() - (shard_count - shard);
+        index = std::max(index, min_index);
+        while (index < max_index && token_offsets[index] < token_target) {
+            index++;
+        }
+        shard_begins[shard] = index;
+    }
+    return shard_begins;
+}
+
+TrlError trl_translate_sharded(const TrlModel* const* models, const size_t model_count, const TrlString* const* source, const TrlString** target, const size_t count) {
+    return run_fallible([models, model_count, source, target, count] {
+        if (model_count == 0) {
+            throw std::runtime_error("Sharded translation requires at least one model");
+        }
+        const std::shared_ptr<ModelData>& data = models[0]->data;
+        for (size_t i = 1; i < model_count; i++) {
+            if (models[i]->data != data) {
+                throw std::runtime_error("Sharded translation requires all models to be clones of the same model");
+            }
+        }
+
+        std::vector<std::shared_ptr<TokenizedString>> batch;
+        batch.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            batch.push_back(source[i]->get_tokenized(data->source_parameters()));
+        }
+
+        const size_t shard_count = std::min(model_count, count);
+        const std::vector<size_t> shard_begins = split_by_token_budget(batch, shard_count);
+
+        // Results are only wrapped once every shard has succeeded, so that nothing leaks if one fails
+        std::vector<std::shared_ptr<TokenizedString>> results(count);
+        std::vector<std::exception_ptr> errors(shard_count);
+
+        const auto run_shard = [&](const size_t shard) {
+            try {
+                const size_t begin = shard_begins[shard];
+                std::vector<std::shared_ptr<TokenizedString>> shard_batch(batch.begin() + begin, batch.begin() + shard_begins[shard + 1]);
+                models[shard]->evaluate(std::move(shard_batch), data->mini_batch_words, [&results, begin](const size_t i, std::shared_ptr<TokenizedString>&& string) {
+                    results[begin + i] = std::move(string);
+                });
+            } catch (...) {
+                errors[shard] = std::current_exception();
+            }
+        };
+
+        // The first shard runs on the calling thread, and every other shard on its model's worker, which is kept between
+        // calls so that repeated large jobs do not start and join threads every time
+        std::vector<std::future<void>> pending;
+        pending.reserve(shard_count > 0 ? shard_count - 1 : 0);
+        const auto wait_pending = [&pending] {
+            for (std::future<void>& future : pending) {
+                future.wait();
+            }
+        };
+        try {
+            for (size_t shard = 1; shard < shard_count; shard++) {
+                pending.push_back(models[shard]->get_worker().submit([&run_shard, shard] {
+                    run_shard(shard);
+                }));
+            }
+        } catch (...) {
+            // Shards that were already submitted refer to our state
+            wait_pending();
+            throw;
+        }
+        if (shard_count > 0) {
+            run_shard(0);
+        }
+        wait_pending();
+
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            target[i] = new TrlString(std::move(results[i]));
+        }
+    });
+}
+
+// Enough for a chunk of prose to be translated as a batch of a few dozen sentences
+static constexpr size_t DEFAULT_STREAM_CHUNK_SIZE = 8192;
+
+struct StreamChunk {
+    size_t sequence;
+    std::shared_ptr<TokenizedString> source;
+    // Null until translated, and for chunks without any segments, which are written through as they are
+    std::shared_ptr<TokenizedString> translated;
+};
+
+// A chunk only grows to this many times chunk_size while waiting for a sentence boundary
+static constexpr size_t MAX_STREAM_CHUNK_GROWTH = 16;
+
+// Returns the length of the longest prefix of `text` that does not end within a UTF-8 sequence. Invalid sequences are
+// left to tokenization
+static size_t complete_utf8_length(const std::string& text) {
+    const size_t size = text.size();
+    for (size_t length = 1; length <= std::min<size_t>(size, 4); length++) {
+        const auto byte = static_cast<unsigned char>(text[size - length]);
+        if ((byte & 0xC0) == 0x80) {
+            continue;
+        }
+        const size_t expected = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+        return expected > length ? size - length : size;
+    }
+    return size;
+}
+
+// Reads text up to the start of its last sentence, which may be incomplete, so that sentences are split with all of
+// their text available even if they span reads. The remainder is carried over into the next chunk, along with any bytes
+// of a character that was not read completely
+class StreamChunker {
+    const TrlStreamReader reader;
+    void* const user_data;
+    const size_t chunk_size;
+    const TokenizationParameters parameters;
+    std::string buffer;
+    bool ended = false;
+
+    void fill(const size_t size) {
+        while (buffer.size() < size && !ended) {
+            const size_t offset = buffer.size();
+            buffer.resize(size);
+            size_t read = 0;
+            if (reader(user_data, buffer.data() + offset, size - offset, &read) != 0) {
+                throw std::runtime_error("Failed to read from stream");
+            }
+            buffer.resize(offset + std::min(read, size - offset));
+            ended = read == 0;
+        }
+    }
+
+public:
+    StreamChunker(
+        const TrlStreamReader reader,
+        void* user_data,
+        const size_t chunk_size,
+        TokenizationParameters&& parameters
+    ): reader(reader),
+       user_data(user_data),
+       chunk_size(chunk_size),
+       parameters(std::move(parameters)) {
+    }
+
+    // Returns the next chunk of the stream, or null once it has been read entirely
+    [[nodiscard]] std::shared_ptr<TokenizedString> next() {
+        size_t fill_size = chunk_size;
+        while (true) {
+            fill(fill_size);
+            if (buffer.empty()) {
+                return nullptr;
+            }
+
+            const size_t complete_length = ended ? buffer.size() : complete_utf8_length(buffer);
+            std::string incomplete = buffer.substr(complete_length);
+            buffer.resize(complete_length);
+            auto plain = std::make_shared<std::string>(std::move(buffer));
+            buffer.clear();
+            std::shared_ptr<TokenizedString> tokenized = tokenize(plain, TokenizationParameters(parameters));
+            const std::vector<TokenizedSegment>& segments = tokenized->segments;
+            if (ended || (segments.empty() && !plain->empty())) {
+                buffer = std::move(incomplete);
+                return tokenized;
+            }
+
+            // The last sentence may still continue, so it is left for the next chunk, along with any segments that it
+            // was wrapped into for being longer than max-length-break
+            size_t last_sentence = segments.empty() ? 0 : segments.size() - 1;
+            while (last_sentence > 0 && segments[last_sentence].continued) {
+                last_sentence--;
+            }
+            if (last_sentence == 0 && plain->size() >= chunk_size * MAX_STREAM_CHUNK_GROWTH) {
+                // Memory stays bounded for a sentence this long by cutting it where it was wrapped, which may be mid-word
+                if (segments.size() > 1) {
+                    last_sentence = segments.size() - 1;
+                } else {
+                    // Without wrapping, such as for a few very long tokens, it is cut before its last token, or else
+                    // after the last whole character read so far. The cut text is tokenized again on its own
+                    const std::vector<Token>& tokens = segments.front().tokens;
+                    const size_t cut = tokens.size() > 1 ? tokens.back().begin : plain->size();
+                    buffer = plain->substr(cut) + incomplete;
+                    if (cut == plain->size()) {
+                        return tokenized;
+                    }
+                    plain->resize(cut);
+                    return tokenize(plain, TokenizationParameters(parameters));
+                }
+            }
+            if (last_sentence == 0) {
+                buffer = std::move(*plain) + incomplete;
+                fill_size = buffer.size() + chunk_size;
+                continue;
+            }
+
+            const size_t cut = segments[last_sentence].tokens.front().begin;
+            buffer = plain->substr(cut) + incomplete;
+            plain->resize(cut);
+            return std::make_shared<TokenizedString>(
+                TokenizationParameters(parameters),
+                std::move(plain),
+                std::vector<TokenizedSegment>(segments.begin(), segments.begin() + static_cast<ptrdiff_t>(last_sentence))
+            );
+        }
+    }
+};
+
+// Pipelines reading and tokenization on the calling thread, translation on a thread for each model, and detokenization
+// and writing on another thread. At most max_in_flight chunks are held at once, which bounds memory regardless of the
+// length of the stream, including chunks that are translated out of order and wait to be written
+class StreamPipeline {
+    const std::vector<const TrlModel*> models;
+    const TrlStreamWriter writer;
+    void* const writer_data;
+    const size_t max_in_flight;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<StreamChunk> pending;
+    std::map<size_t, StreamChunk> translated;
+    size_t in_flight = 0;
+    size_t chunk_count = 0;
+    bool reading_done = false;
+    std::exception_ptr error;
+
+    void fail() {
+        std::lock_guard guard(mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+        changed.notify_all();
+    }
+
+    void run_translator(const TrlModel& model) {
+        try {
+            while (true) {
+                StreamChunk chunk;
+                {
+                    std::unique_lock lock(mutex);
+                    changed.wait(lock, [this] {
+                        return error || !pending.empty() || reading_done;
+                    });
+                    if (error || pending.empty()) {
+                        return;
+                    }
+                    chunk = std::move(pending.front());
+                    pending.pop_front();
+                }
+
+                model.evaluate({chunk.source}, model.data->mini_batch_words, [&chunk](size_t, std::shared_ptr<TokenizedString>&& string) {
+                    chunk.translated = std::move(string);
+                });
+
+                std::lock_guard guard(mutex);
+                const size_t sequence = chunk.sequence;
+                translated.emplace(sequence, std::move(chunk));
+                changed.notify_all();
+            }
+        } catch (...) {
+            fail();
+        }
+    }
+
+    void run_writer() {
+        try {
+            for (size_t sequence = 0;; sequence++) {
+                StreamChunk chunk;
+                {
+                    std::unique_lock lock(mutex);
+                    changed.wait(lock, [this, sequence] {
+                        return error || translated.count(sequence) > 0 || (reading_done && sequence == chunk_count);
+                    });
+                    if (error || translated.count(sequence) == 0) {
+                        return;
+                    }
+                    const auto entry = translated.find(sequence);
+                    chunk = std::move(entry->second);
+                    translated.erase(entry);
+                }
+
+                const std::shared_ptr<std::string> text = chunk.translated ? detokenize(*chunk.translated)->plain : chunk.source->plain;
+                if (!text->empty() && writer(writer_data, text->data(), text->size()) != 0) {
+                    throw std::runtime_error("Failed to write to stream");
+                }
+
+                std::lock_guard guard(mutex);
+                in_flight--;
+                changed.notify_all();
+            }
+        } catch (...) {
+            fail();
+        }
+    }
+
+    // Blocks until the chunk can be held without exceeding max_in_flight, returning false if the pipeline has failed
+    bool push(std::shared_ptr<TokenizedString>&& source) {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [this] {
+            return error || in_flight < max_in_flight;
+        });
+        if (error) {
+            return false;
+        }
+        StreamChunk chunk{chunk_count++, std::move(source), nullptr};
+        in_flight++;
+        if (chunk.source->segments.empty()) {
+            translated.emplace(chunk.sequence, std::move(chunk));
+        } else {
+            pending.push_back(std::move(chunk));
+        }
+        changed.notify_all();
+        return true;
+    }
+
+public:
+    StreamPipeline(
+        std::vector<const TrlModel*>&& models,
+        const TrlStreamWriter writer,
+        void* writer_data,
+        const size_t max_in_flight
+    ): models(std::move(models)),
+       writer(writer),
+       writer_data(writer_data),
+       max_in_flight(max_in_flight) {
+    }
+
+    void run(StreamChunker& chunker) {
+        std::vector<std::thread> threads;
+        threads.reserve(models.size() + 1);
+        for (const TrlModel* model : models) {
+            threads.emplace_back([this, model] {
+                run_translator(*model);
+            });
+        }
+        threads.emplace_back([this] {
+            run_writer();
+        });
+
+        try {
+            while (std::shared_ptr<TokenizedString> chunk = chunker.next()) {
+                if (!push(std::move(chunk))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+        {
+            std::lock_guard guard(mutex);
+            reading_done = true;
+            changed.notify_all();
+        }
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+TrlError trl_translate_stream(
+    const TrlModel* const* models,
+    const size_t model_count,
+    const TrlStreamReader reader,
+    void* reader_data,
+    const TrlStreamWriter writer,
+    void* writer_data,
+    const TrlStreamOptions* options
+) {
+    return run_fallible([models, model_count, reader, reader_data, writer, writer_data, options] {
+        if (model_count == 0) {
+            throw std::runtime_error("Stream translation requires at least one model");
+        }
+        const std::shared_ptr<ModelData>& data = models[0]->data;
+        for (size_t i = 1; i < model_count; i++) {
+            if (models[i]->data != data) {
+                throw std::runtime_error("Stream translation requires all models to be clones of the same model");
+            }
+        }
+
+        const size_t chunk_size = options && options->chunk_size > 0 ? options->chunk_size : DEFAULT_STREAM_CHUNK_SIZE;
+        // Enough for every model to have a chunk queued behind the one it is translating, and for one to be written
+        const size_t max_in_flight = options && options->max_chunks_in_flight > 0 ? options->max_chunks_in_flight : model_count * 2 + 2;
+
+        StreamChunker chunker(reader, reader_data, chunk_size, data->source_parameters());
+        StreamPipeline pipeline(std::vector<const TrlModel*>(models, models + model_count), writer, writer_data, max_in_flight);
+        pipeline.run(chunker);
+    });
+}
+
+static constexpr double DEFAULT_BATCHER_MAX_WAIT_MS = 5.0;
+static constexpr size_t DEFAULT_BATCHER_MAX_BATCH_WORDS = 1024;
+
+struct TrlCancellation {
+    // Shared with every request the token was passed to, so that the token can be destroyed while they are still queued
+    const std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+};
+
+struct BatcherRequest {
+    std::shared_ptr<TokenizedString> tokenized;
+    size_t token_count;
+    // Called with the translated string, or with the error message if translation failed
+    std::function<void(std::shared_ptr<TokenizedString>&&, const std::string*)> complete;
+    std::chrono::steady_clock::time_point submitted;
+    int priority;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    std::shared_ptr<const std::atomic<bool>> cancellation;
+
+    // Returns why this request should no longer be translated, or null if it still should be
+    [[nodiscard]] const char* cancelled_reason(const std::chrono::steady_clock::time_point now) const {
+        if (cancellation && cancellation->load(std::memory_order_relaxed)) {
+            return "Translation was cancelled";
+        }
+        if (deadline && now > *deadline) {
+            return "Translation deadline was exceeded";
+        }
+        return nullptr;
+    }
+};
+
+struct BatcherStats {
+    std::atomic<size_t> requests{0};
+    std::atomic<size_t> batches{0};
+    std::atomic<size_t> batch_words{0};
+    std::atomic<size_t> total_queue_delay_us{0};
+    std::atomic<size_t> max_queue_delay_us{0};
+    std::atomic<size_t> cancelled_requests{0};
+    std::atomic<size_t> shed_requests{0};
+
+    void record(const std::vector<BatcherRequest>& batch, const size_t words, const std::chrono::steady_clock::time_point now) {
+        requests.fetch_add(batch.size(), std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+        batch_words.fetch_add(words, std::memory_order_relaxed);
+        for (const BatcherRequest& request : batch) {
+            const auto delay_us = static_cast<size_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - request.submitted).count());
+            total_queue_delay_us.fetch_add(delay_us, std::memory_order_relaxed);
+            size_t max_delay_us = max_queue_delay_us.load(std::memory_order_relaxed);
+            while (delay_us > max_delay_us && !max_queue_delay_us.compare_exchange_weak(max_delay_us, delay_us, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    void reset() {
+        requests.store(0, std::memory_order_relaxed);
+        batches.store(0, std::memory_order_relaxed);
+        batch_words.store(0, std::memory_order_relaxed);
+        total_queue_delay_us.store(0, std::memory_order_relaxed);
+        max_queue_delay_us.store(0, std::memory_order_relaxed);
+        cancelled_requests.store(0, std::memory_order_relaxed);
+        shed_requests.store(0, std::memory_order_relaxed);
+    }
+};
+
+struct TrlBatcher {
+    const std::vector<const TrlModel*> models;
+    const std::chrono::steady_clock::duration max_wait;
+    const size_t max_batch_words;
+    const size_t max_queued_requests;
+
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    // Ordered by descending priority, and then by submission
+    std::deque<BatcherRequest> queue;
+    size_t queued_words = 0;
+    bool stopping = false;
+
+    mutable BatcherStats stats;
+    std::vector<std::thread> workers;
+
+    TrlBatcher(std::vector<const TrlModel*>&& models, const double max_wait_ms, const size_t max_batch_words, const size_t max_queued_requests)
+        : models(std::move(models)),
+          max_wait(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(max_wait_ms))),
+          max_batch_words(max_batch_words),
+          max_queued_requests(max_queued_requests) {
+        workers.reserve(this->models.size());
+        for (const TrlModel* model : this->models) {
+            workers.emplace_back([this, model] {
+                run_worker(*model);
+            });
+        }
+    }
+
+    TrlBatcher(const TrlBatcher&) = delete;
+
+    TrlBatcher& operator=(const TrlBatcher&) = delete;
+
+    ~TrlBatcher() {
+        {
+            std::lock_guard guard(mutex);
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Moves every queued request that was cancelled or whose deadline passed into `cancelled`, wherever it is queued:
+    // lower priority requests might otherwise wait behind a steady stream of higher priority ones long after expiring
+    void take_cancelled(const std::chrono::steady_clock::time_point now, std::vector<BatcherRequest>& cancelled) {
+        auto kept = queue.begin();
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->cancelled_reason(now)) {
+                queued_words -= it->token_count;
+                cancelled.push_back(std::move(*it));
+            } else {
+                if (kept != it) {
+                    *kept = std::move(*it);
+                }
+                ++kept;
+            }
+        }
+        queue.erase(kept, queue.end());
+    }
+
+    void submit(BatcherRequest&& request) {
+        std::optional<BatcherRequest> shed;
+        std::vector<BatcherRequest> cancelled;
+        bool full;
+        {
+            std::lock_guard guard(mutex);
+            if (max_queued_requests > 0 && queue.size() >= max_queued_requests) {
+                // Expired requests make room before any live request is shed
+                take_cancelled(std::chrono::steady_clock::now(), cancelled);
+            }
+            if (max_queued_requests > 0 && queue.size() >= max_queued_requests) {
+                // Make room by shedding the newest of the lowest priority requests, if it is below this one
+                if (queue.back().priority >= request.priority) {
+                    stats.shed_requests.fetch_add(1, std::memory_order_relaxed);
+                    throw std::runtime_error("Batcher queue is full");
+                }
+                queued_words -= queue.back().token_count;
+                shed.emplace(std::move(queue.back()));
+                queue.pop_back();
+            }
+
+            const auto position = std::upper_bound(queue.begin(), queue.end(), request.priority, [](const int priority, const BatcherRequest& queued) {
+                return priority > queued.priority;
+            });
+            queued_words += request.token_count;
+            queue.insert(position, std::move(request));
+            full = queued_words >= max_batch_words;
+        }
+        // Workers waiting for a partial batch to fill only need to be woken once it is full
+        if (full) {
+            queue_changed.notify_all();
+        } else {
+            queue_changed.notify_one();
+        }
+
+        complete_cancelled(cancelled);
+        if (shed) {
+            stats.shed_requests.fetch_add(1, std::memory_order_relaxed);
+            const std::string error = "Translation was shed for a higher priority request";
+            shed->complete(nullptr, &error);
+        }
+    }
+
+    // Waits until a batch is full or its oldest request has waited for max_wait, and takes it from the queue, highest
+    // priority first. Requests anywhere in the queue that were cancelled or expired are moved into `cancelled`, and the
+    // returned batch may be empty if these were all that was queued
+    [[nodiscard]] std::vector<BatcherRequest> take_batch(std::vector<BatcherRequest>& cancelled) {
+        std::unique_lock lock(mutex);
+        while (true) {
+            queue_changed.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return {};
+            }
+            std::chrono::steady_clock::time_point oldest = queue.front().submitted;
+            for (const BatcherRequest& request : queue) {
+                oldest = std::min(oldest, request.submitted);
+            }
+            queue_changed.wait_until(lock, oldest + max_wait, [this] { return stopping || queue.empty() || queued_words >= max_batch_words; });
+            // Another worker may have taken the batch while we were waiting
+            if (!queue.empty()) {
+                break;
+            }
+        }
+
+        take_cancelled(std::chrono::steady_clock::now(), cancelled);
+        std::vector<BatcherRequest> batch;
+        size_t batch_words = 0;
+        while (!queue.empty() && (batch.empty() || batch_words + queue.front().token_count <= max_batch_words)) {
+            BatcherRequest& request = queue.front();
+            batch_words += request.token_count;
+            batch.push_back(std::move(request));
+            queue.pop_front();
+        }
+        queued_words -= batch_words;
+        const bool remaining = !queue.empty();
+        lock.unlock();
+        if (remaining) {
+            queue_changed.notify_one();
+        }
+        return batch;
+    }
+
+    void complete_cancelled(std::vector<BatcherRequest>& cancelled) {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        stats.cancelled_requests.fetch_add(cancelled.size(), std::memory_order_relaxed);
+        for (BatcherRequest& request : cancelled) {
+            const std::string error = request.cancelled_reason(now);
+            request.complete(nullptr, &error);
+        }
+        cancelled.clear();
+    }
+
+    void run_worker(const TrlModel& model) {
+        std::vector<BatcherRequest> cancelled;
+        while (true) {
+            std::vector<BatcherRequest> batch = take_batch(cancelled);
+            complete_cancelled(cancelled);
+            if (batch.empty()) {
+                if (stopping_and_drained()) {
+                    return;
+                }
+                continue;
+            }
+
+            std::vector<std::shared_ptr<TokenizedString>> strings;
+            strings.reserve(batch.size());
+            size_t batch_words = 0;
+            for (const BatcherRequest& request : batch) {
+                strings.push_back(request.tokenized);
+                batch_words += request.token_count;
+            }
+            stats.record(batch, batch_words, std::chrono::steady_clock::now());
+
+            // A failing string only fails its own request, rather than every request it was batched with. Strings
+            // that are cancelled or expire mid-translation stop being decoded, while the rest of the batch completes
+            std::vector<std::shared_ptr<TokenizedString>> results(batch.size());
+            std::vector<std::string> errors(batch.size());
+            translate_bisecting(model, strings, 0, strings.size(), results, errors, [&batch](const size_t i) {
+                return batch[i].cancelled_reason(std::chrono::steady_clock::now()) != nullptr;
+            });
+
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (results[i]) {
+                    batch[i].complete(std::move(results[i]), nullptr);
+                } else if (const char* reason = batch[i].cancelled_reason(std::chrono::steady_clock::now())) {
+                    stats.cancelled_requests.fetch_add(1, std::memory_order_relaxed);
+                    const std::string error = reason;
+                    batch[i].complete(nullptr, &error);
+                } else {
+                    batch[i].complete(nullptr, &errors[i]);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] bool stopping_and_drained() {
+        std::lock_guard guard(mutex);
+        return stopping && queue.empty();
+    }
+};
+
+TrlCancellation* trl_create_cancellation() {
+    return new TrlCancellation();
+}
+
+void trl_cancel(TrlCancellation* cancellation) {
+    cancellation->cancelled->store(true, std::memory_order_relaxed);
+}
+
+void trl_destroy_cancellation(TrlCancellation* cancellation) {
+    delete cancellation;
+}
+
+TrlBatcher* trl_create_batcher(const TrlModel* const* models, const size_t model_count, const TrlBatcherOptions* options) {
+    return create_fallible<TrlBatcher>([models, model_count, options] {
+        if (model_count == 0) {
+            throw std::runtime_error("Batcher requires at least one model");
+        }
+        for (size_t i = 1; i < model_count; i++) {
+            if (models[i]->data != models[0]->data) {
+                throw std::runtime_error("Batcher requires all models to be clones of the same model");
+            }
+        }
+        const double max_wait_ms = options && options->max_wait_ms > 0.0 ? options->max_wait_ms : DEFAULT_BATCHER_MAX_WAIT_MS;
+        const size_t max_batch_words = options && options->max_batch_words > 0 ? options->max_batch_words : DEFAULT_BATCHER_MAX_BATCH_WORDS;
+        const size_t max_queued_requests = options ? options->max_queued_requests : 0;
+        return new TrlBatcher(std::vector<const TrlModel*>(models, models + model_count), max_wait_ms, max_batch_words, max_queued_requests);
+    });
+}
+
+static void submit_to_batcher(
+    TrlBatcher& batcher,
+    const TrlString& source,
+    const TrlRequestOptions* options,
+    std::function<void(std::shared_ptr<TokenizedString>&&, const std::string*)>&& complete
+) {
+    std::shared_ptr<TokenizedString> tokenized = source.get_tokenized(batcher.models[0]->data->source_parameters());
+    const size_t token_count = count_tokens(*tokenized);
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (options && options->timeout_ms > 0.0) {
+        deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(options->timeout_ms));
+    }
+    std::shared_ptr<const std::atomic<bool>> cancellation;
+    if (options && options->cancellation) {
+        cancellation = options->cancellation->cancelled;
+    }
+
+    batcher.submit({
+        std::move(tokenized),
+        token_count,
+        std::move(complete),
+        now,
+        options ? options->priority : 0,
+        deadline,
+        std::move(cancellation)
+    });
+}
+
+TrlError trl_batcher_submit(TrlBatcher* batcher, const TrlString* source, const TrlRequestOptions* options, const TrlTranslateCallback callback, void* user_data) {
+    return run_fallible([batcher, source, options, callback, user_data] {
+        submit_to_batcher(*batcher, *source, options, [callback, user_data](std::shared_ptr<TokenizedString>&& target, const std::string* error) {
+            if (error) {
+                // The callback runs on the worker thread, which is where it would look for the message
+                last_error = *error;
+                callback(user_data, nullptr, TRL_ERROR);
+            } else {
+                callback(user_data, new TrlString(std::move(target)), TRL_OK);
+            }
+        });
+    });
+}
+
+TrlError trl_batcher_translate(TrlBatcher* batcher, const TrlString* source, const TrlRequestOptions* options, const TrlString** target) {
+    return run_fallible([batcher, source, options, target] {
+        std::promise<std::shared_ptr<TokenizedString>> result;
+        std::future<std::shared_ptr<TokenizedString>> future = result.get_future();
+        submit_to_batcher(*batcher, *source, options, [&result](std::shared_ptr<TokenizedString>&& translated, const std::string* error) {
+            if (error) {
+                result.set_exception(std::make_exception_ptr(std::runtime_error(*error)));
+            } else {
+                result.set_value(std::move(translated));
+            }
+        });
+        *target = new TrlString(future.get());
+    });
+}
+
+void trl_get_batcher_stats(const TrlBatcher* batcher, TrlBatcherStats* stats) {
+    const BatcherStats& batcher_stats = batcher->stats;
+    stats->requests = batcher_stats.requests.load(std::memory_order_relaxed);
+    stats->batches = batcher_stats.batches.load(std::memory_order_relaxed);
+    stats->batch_words = batcher_stats.batch_words.load(std::memory_order_relaxed);
+    stats->total_queue_delay_ms = static_cast<double>(batcher_stats.total_queue_delay_us.load(std::memory_order_relaxed)) / 1000.0;
+    stats->max_queue_delay_ms = static_cast<double>(batcher_stats.max_queue_delay_us.load(std::memory_order_relaxed)) / 1000.0;
+    stats->cancelled_requests = batcher_stats.cancelled_requests.load(std::memory_order_relaxed);
+    stats->shed_requests = batcher_stats.shed_requests.load(std::memory_order_relaxed);
+}
+
+void trl_reset_batcher_stats(const TrlBatcher* batcher) {
+    batcher->stats.reset();
+}
+
+void trl_destroy_batcher(TrlBatcher* batcher) {
+    delete batcher;
+}
+
+// Matches the default idle timeout of PooledTranslationModel in the Java bindings
+static constexpr std::chrono::minutes IDLE_INSTANCE_TIMEOUT(1);
+
+// One published model of a TrlModelHandle, along with the instances translating with it. Requests hold a reference
+// for as long as they translate, so a version that was swapped out is only torn down once its last request finishes
+struct ModelVersion {
+    struct IdleInstance {
+        std::unique_ptr<const TrlModel> model;
+        std::chrono::steady_clock::time_point released_at;
+    };
+
+    const size_t number;
+    // Only used to create more instances from, which does not touch its graph: it may be translating at the same time.
+    // This is never trimmed, so that there is always an instance to clone from
+    const TrlModel* const prototype;
+
+    std::mutex mutex;
+    // Ordered by release time, such that the most recently used instances are taken first and the others are left to
+    // expire at the front
+    std::deque<IdleInstance> idle;
+    size_t instance_count;
+
+    ModelVersion(const size_t number, std::vector<std::unique_ptr<const TrlModel>>&& instances)
+        : number(number),
+          prototype(instances.front().get()),
+          instance_count(instances.size()) {
+        const auto now = std::chrono::steady_clock::now();
+        for (std::unique_ptr<const TrlModel>& instance : instances) {
+            idle.push_back({std::move(instance), now});
+        }
+    }
+
+    [[nodiscard]] std::unique_ptr<const TrlModel> acquire() {
+        {
+            std::lock_guard guard(mutex);
+            if (!idle.empty()) {
+                std::unique_ptr<const TrlModel> model = std::move(idle.back().model);
+                idle.pop_back();
+                return model;
+            }
+            instance_count++;
+        }
+        try {
+            return std::unique_ptr<const TrlModel>(clone_model(*prototype));
+        } catch (...) {
+            std::lock_guard guard(mutex);
+            instance_count--;
+            throw;
+        }
+    }
+
+    // Also destroys instances that have not been used for IDLE_INSTANCE_TIMEOUT, so that clones created for a burst of
+    // concurrent requests are not kept, nor carried over to the next version by TrlModelHandle::swap
+    void release(std::unique_ptr<const TrlModel>&& model) {
+        std::vector<std::unique_ptr<const TrlModel>> expired;
+        {
+            std::lock_guard guard(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            idle.push_back({std::move(model), now});
+            for (auto it = idle.begin(); it != idle.end() && now - it->released_at >= IDLE_INSTANCE_TIMEOUT;) {
+                if (it->model.get() == prototype) {
+                    ++it;
+                    continue;
+                }
+                expired.push_back(std::move(it->model));
+                it = idle.erase(it);
+                instance_count--;
+            }
+        }
+        // Destroyed outside the lock, as tearing down a graph takes a while
+    }
+
+    [[nodiscard]] size_t get_instance_count() {
+        std::lock_guard guard(mutex);
+        return instance_count;
+    }
+};
+
+struct TrlModelHandle {
+    mutable std::mutex mutex;
+    std::shared_ptr<ModelVersion> current;
+    // Loads the models of trl_swap_model_from_bundle one after another, started by the first of them
+    std::unique_ptr<ModelWorker> loader;
+
+    explicit TrlModelHandle(std::shared_ptr<ModelVersion>&& version): current(std::move(version)) {
+    }
+
+    TrlModelHandle(const TrlModelHandle&) = delete;
+
+    TrlModelHandle& operator=(const TrlModelHandle&) = delete;
+
+    ~TrlModelHandle() {
+        // Swaps that are still queued complete first. The loader is moved out, as they need the mutex to publish
+        std::unique_ptr<ModelWorker> pending_loader;
+        {
+            std::lock_guard guard(mutex);
+            pending_loader.swap(loader);
+        }
+        pending_loader.reset();
+    }
+
+    [[nodiscard]] std::shared_ptr<ModelVersion> get_current() const {
+        std::lock_guard guard(mutex);
+        return current;
+    }
+
+    // Warms up the given model along with enough clones to match the current version, and publishes them to new requests
+    void swap(std::unique_ptr<const TrlModel>&& model, const TrlWarmupOptions* warmup) {
+        const std::shared_ptr<ModelVersion> previous = get_current();
+        const size_t instance_count = std::max<size_t>(1, previous->get_instance_count());
+
+        std::vector<std::unique_ptr<const TrlModel>> instances;
+        instances.reserve(instance_count);
+        instances.push_back(std::move(model));
+        while (instances.size() < instance_count) {
+            instances.emplace_back(clone_model(*instances.front()));
+        }
+        for (const std::unique_ptr<const TrlModel>& instance : instances) {
+            warmup_model(*instance, warmup);
+        }
+
+        std::lock_guard guard(mutex);
+        current = std::make_shared<ModelVersion>(current->number + 1, std::move(instances));
+    }
+};
+
+TrlModelHandle* trl_create_model_handle(const TrlModel* model) {
+    return create_fallible<TrlModelHandle>([model] {
+        std::vector<std::unique_ptr<const TrlModel>> instances;
+        instances.emplace_back(model);
+        return new TrlModelHandle(std::make_shared<ModelVersion>(1, std::move(instances)));
+    });
+}
+
+TrlError trl_handle_translate(const TrlModelHandle* handle, const TrlString* const* source, const TrlString** target, const size_t count) {
+    return run_fallible([handle, source, target, count] {
+        // Held until translation completes, so that a swap cannot tear down the model underneath us
+        const std::shared_ptr<ModelVersion> version = handle->get_current();
+        std::unique_ptr<const TrlModel> model = version->acquire();
+
+        // Strings tokenized for a previous version are retokenized here if its vocabulary differs
+        std::vector<std::shared_ptr<TokenizedString>> batch;
+        std::vector<std::shared_ptr<TokenizedString>> results(count);
+        try {
+            batch.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                batch.push_back(source[i]->get_tokenized(model->data->source_parameters()));
+            }
+            model->evaluate(std::move(batch), model->data->mini_batch_words, [&results](const size_t i, std::shared_ptr<TokenizedString>&& string) {
+                results[i] = std::move(string);
+            });
+        } catch (...) {
+            version->release(std::move(model));
+            throw;
+        }
+        version->release(std::move(model));
+
+        for (size_t i = 0; i < count; i++) {
+            target[i] = new TrlString(std::move(results[i]));
+        }
+    });
+}
+
+TrlError trl_swap_model(TrlModelHandle* handle, const TrlModel* model, const TrlWarmupOptions* warmup) {
+    return run_fallible([handle, model, warmup] {
+        handle->swap(std::unique_ptr<const TrlModel>(model), warmup);
+    });
+}
+
+TrlError trl_swap_model_from_bundle(TrlModelHandle* handle, const char* path, const char* yaml_config, const TrlSwapCallback callback, void* user_data) {
+    return run_fallible([handle, path, yaml_config, callback, user_data] {
+        std::string path_copy(path);
+        std::optional<std::string> yaml_config_copy;
+        if (yaml_config) {
+            yaml_config_copy.emplace(yaml_config);
+        }
+
+        std::lock_guard guard(handle->mutex);
+        if (!handle->loader) {
+            handle->loader = std::make_unique<ModelWorker>();
+        }
+        // Nothing here throws, as failures are reported through the callback instead of the future
+        (void) handle->loader->submit([handle, path = std::move(path_copy), yaml_config = std::move(yaml_config_copy), callback, user_data] {
+            const TrlModel* model = trl_create_model_from_bundle(path.c_str(), yaml_config ? yaml_config->c_str() : nullptr, 1);
+            // Errors are left in last_error of this thread, where the callback will look for them
+            const TrlError status = model ? trl_swap_model(handle, model, nullptr) : TRL_ERROR;
+            if (callback) {
+                callback(user_data, status);
+            }
+        });
+    });
+}
+
+size_t trl_get_model_handle_version(const TrlModelHandle* handle) {
+    return handle->get_current()->number;
+}
+
+void trl_destroy_model_handle(TrlModelHandle* handle) {
+    delete handle;
+}
+
+static constexpr size_t DEFAULT_AUTOTUNE_MINI_BATCH_WORDS[] = {256, 512, 1024, 2048};
+static constexpr size_t DEFAULT_AUTOTUNE_ITERATIONS = 3;
+
+struct AutotuneMeasurement {
+    size_t clones;
+    size_t mini_batch_words;
+    size_t max_length_break;
+    size_t workspace;
+    double tokens_per_second;
+    double p99_latency_ms;
+};
+
+static std::vector<size_t> autotune_candidates(const size_t* values, const size_t count, std::vector<size_t>&& defaults) {
+    std::vector<size_t> candidates = values && count > 0 ? std::vector<size_t>(values, values + count) : std::move(defaults);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    return candidates;
+}
+
+static std::vector<size_t> default_autotune_clone_counts() {
+    const size_t hardware_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    std::vector<size_t> clone_counts;
+    for (size_t clones = 1; clones < hardware_threads; clones *= 2) {
+        clone_counts.push_back(clones);
+    }
+    clone_counts.push_back(hardware_threads);
+    return clone_counts;
+}
+
+// Translates the corpus in mini-batches taken from a shared queue by the first clone_count models, returning the time
+// taken for every mini-batch and the total time in seconds
+static double run_autotune_pass(
+    const std::vector<const TrlModel*>& models,
+    const size_t clone_count,
+    const std::vector<std::shared_ptr<TokenizedString>>& corpus,
+    const std::vector<size_t>& mini_batch_begins,
+    std::vector<double>& latencies_ms
+) {
+    const size_t mini_batch_count = mini_batch_begins.size() - 1;
+    std::atomic<size_t> next_mini_batch{0};
+    std::vector<std::vector<double>> clone_latencies_ms(clone_count);
+    std::vector<std::exception_ptr> errors(clone_count);
+
+    const auto run_clone = [&](const size_t clone) {
+        try {
+            for (size_t mini_batch = next_mini_batch++; mini_batch < mini_batch_count; mini_batch = next_mini_batch++) {
+                std::vector<std::shared_ptr<TokenizedString>> strings(corpus.begin() + mini_batch_begins[mini_batch], corpus.begin() + mini_batch_begins[mini_batch + 1]);
+                const auto start = std::chrono::steady_clock::now();
+                models[clone]->evaluate(std::move(strings), 0, [](size_t, std::shared_ptr<TokenizedString>&&) {
+                });
+                clone_latencies_ms[clone].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+        } catch (...) {
+            errors[clone] = std::current_exception();
+        }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    threads.reserve(clone_count - 1);
+    for (size_t clone = 1; clone < clone_count; clone++) {
+        threads.emplace_back(run_clone, clone);
+    }
+    run_clone(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    for (const std::vector<double>& clone_latencies : clone_latencies_ms) {
+        latencies_ms.insert(latencies_ms.end(), clone_latencies.begin(), clone_latencies.end());
+    }
+    return seconds;
+}
+
+static AutotuneMeasurement measure_autotune_configuration(
+    const std::vector<const TrlModel*>& models,
+    const size_t clone_count,
+    const std::vector<std::shared_ptr<TokenizedString>>& corpus,
+    const size_t mini_batch_words,
+    const size_t max_length_break,
+    const size_t workspace,
+    const size_t iterations
+) {
+    const std::vector<size_t> mini_batch_begins = mini_batch_words > 0 ? split_by_mini_batch_words(corpus, mini_batch_words) : std::vector<size_t>{0, corpus.size()};
+    size_t token_count = 0;
+    for (const std::shared_ptr<TokenizedString>& string : corpus) {
+        token_count += count_tokens(*string);
+    }
+
+    std::vector<double> latencies_ms;
+    // The first pass is not measured: it grows the workspace of every clone for these mini-batch shapes
+    run_autotune_pass(models, clone_count, corpus, mini_batch_begins, latencies_ms);
+    latencies_ms.clear();
+
+    double seconds = 0.0;
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        seconds += run_autotune_pass(models, clone_count, corpus, mini_batch_begins, latencies_ms);
+    }
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    const size_t p99_index = (latencies_ms.size() * 99 + 99) / 100 - 1;
+    return {
+        clone_count,
+        mini_batch_words,
+        max_length_break,
+        workspace,
+        static_cast<double>(token_count * iterations) / seconds,
+        latencies_ms[p99_index]
+    };
+}
+
+// Only the tuned options are written, as the result is meant to override the configuration of the bundle
+static std::string write_autotune_config(const AutotuneMeasurement& best, const std::vector<AutotuneMeasurement>& measurements) {
+    std::ostringstream config;
+    config << "# Tuned by trl_autotune on " << current_cpu_tag() << " with " << std::thread::hardware_concurrency() << " hardware threads\n";
+    config << "# clones, mini-batch-words, max-length-break, workspace: source tokens/sec, p99 mini-batch latency\n";
+    for (const AutotuneMeasurement& measurement : measurements) {
+        config << "#   " << measurement.clones << ", " << measurement.mini_batch_words << ", " << measurement.max_length_break << ", " << measurement.workspace << ": "
+               << static_cast<size_t>(measurement.tokens_per_second) << " tokens/sec, " << measurement.p99_latency_ms << " ms\n";
+    }
+    config << "mini-batch-words: " << best.mini_batch_words << "\n";
+    config << "max-length-break: " << best.max_length_break << "\n";
+    config << "workspace: " << best.workspace << "\n";
+    // Not read by this library: the number of instances to create with trl_clone_model
+    config << "clones: " << best.clones << "\n";
+    return config.str();
+}
+
+TrlError trl_autotune(const TrlModel* model, const TrlString* const* samples, const size_t sample_count, const TrlAutotuneOptions* options, TrlAutotuneResult* result) {
+    return run_fallible([model, samples, sample_count, options, result] {
+        if (sample_count == 0) {
+            throw std::runtime_error("Tuning requires at least one sample string");
+        }
+        const ModelData& data = *model->data;
+        const std::vector<size_t> clone_counts = autotune_candidates(
+            options ? options->clone_counts : nullptr, options ? options->clone_count_count : 0,
+            default_autotune_clone_counts()
+        );
+        const std::vector<size_t> mini_batch_words = autotune_candidates(
+            options ? options->mini_batch_words : nullptr, options ? options->mini_batch_words_count : 0,
+            std::vector<size_t>(std::begin(DEFAULT_AUTOTUNE_MINI_BATCH_WORDS), std::end(DEFAULT_AUTOTUNE_MINI_BATCH_WORDS))
+        );
+        const std::vector<size_t> max_length_breaks = autotune_candidates(
+            options ? options->max_length_breaks : nullptr, options ? options->max_length_break_count : 0,
+            {data.max_segment_length}
+        );
+        const size_t configured_workspace = data.options->get<size_t>("workspace");
+        const std::vector<size_t> workspaces = autotune_candidates(
+            options ? options->workspaces : nullptr, options ? options->workspace_count : 0,
+            {configured_workspace}
+        );
+        const size_t iterations = options && options->iterations > 0 ? options->iterations : DEFAULT_AUTOTUNE_ITERATIONS;
+        const double max_p99_latency_ms = options ? options->max_p99_latency_ms : 0.0;
+        if (clone_counts.front() == 0 || max_length_breaks.front() == 0 || workspaces.front() == 0) {
+            throw std::runtime_error("Clone counts, max-length-break and workspace values must be at least 1");
+        }
+
+        // Tokenized directly, so that these do not displace the tokenizations cached for the samples
+        std::vector<std::vector<std::shared_ptr<TokenizedString>>> corpora;
+        for (const size_t max_length_break : max_length_breaks) {
+            std::vector<std::shared_ptr<TokenizedString>>& corpus = corpora.emplace_back();
+            corpus.reserve(sample_count);
+            for (size_t i = 0; i < sample_count; i++) {
+                corpus.push_back(tokenize(samples[i]->get_plain(), {data.vocabs.source, data.vocabs.source_fingerprint, max_length_break, data.segment_split_mode}));
+            }
+        }
+
+        std::vector<AutotuneMeasurement> measurements;
+        for (const size_t workspace : workspaces) {
+            // Instances are only kept for one workspace at a time, and are torn down once it has been measured. The
+            // given model is reused for its own workspace, but other workspaces need graphs of their own
+            std::vector<std::unique_ptr<const TrlModel>> instances;
+            std::vector<const TrlModel*> models;
+            if (workspace == configured_workspace) {
+                models.push_back(model);
+            }
+            while (models.size() < clone_counts.back()) {
+                instances.emplace_back(new TrlModel(instantiate_model(model->data, workspace)));
+                models.push_back(instances.back().get());
+            }
+
+            for (size_t i = 0; i < max_length_breaks.size(); i++) {
+                for (const size_t words : mini_batch_words) {
+                    for (const size_t clones : clone_counts) {
+                        measurements.push_back(measure_autotune_configuration(models, clones, corpora[i], words, max_length_breaks[i], workspace, iterations));
+                    }
+                }
+            }
+        }
+
+        const auto is_better = [max_p99_latency_ms](const AutotuneMeasurement& a, const AutotuneMeasurement& b) {
+            if (max_p99_latency_ms > 0.0) {
+                const bool a_within = a.p99_latency_ms <= max_p99_latency_ms;
+                const bool b_within = b.p99_latency_ms <= max_p99_latency_ms;
+                if (a_within != b_within) {
+                    return a_within;
+                }
+                if (!a_within) {
+                    return a.p99_latency_ms < b.p99_latency_ms;
+                }
+            }
+            return a.tokens_per_second > b.tokens_per_second;
+        };
+        const AutotuneMeasurement best = *std::min_element(measurements.begin(), measurements.end(), is_better);
+
+        result->clones = best.clones;
+        result->mini_batch_words = best.mini_batch_words;
+        result->max_length_break = best.max_length_break;
+        result->workspace = best.workspace;
+        result->tokens_per_second = best.tokens_per_second;
+        result->p99_latency_ms = best.p99_latency_ms;
+        result->config = strdup(write_autotune_config(best, measurements).c_str());
+    });
+}
+
+void trl_get_model_stats(const TrlModel* model, TrlModelStats* stats) {
+    const ShortListStats& short_list_stats = model->data->short_list_stats;
+    const size_t short_list_batches = short_list_stats.batches.load(std::memory_order_relaxed);
+    stats->short_list_batches = short_list_batches;
+    stats->short_list_total_size = short_list_stats.total_size.load(std::memory_order_relaxed);
+    stats->short_list_min_size = short_list_batches > 0 ? short_list_stats.min_size.load(std::memory_order_relaxed) : 0;
+    stats->short_list_max_size = short_list_stats.max_size.load(std::memory_order_relaxed);
+    stats->short_list_last_size = short_list_stats.last_size.load(std::memory_order_relaxed);
+    stats->target_vocab_size = model->data->vocabs.target->size();
+
+    const TranslationStats& translation_stats = model->data->translation_stats;
+    stats->translated_batches = translation_stats.batches.load(std::memory_order_relaxed);
+    stats->source_tokens = translation_stats.source_tokens.load(std::memory_order_relaxed);
+    stats->target_tokens = translation_stats.target_tokens.load(std::memory_order_relaxed);
+
+    const DegenerationStats& degeneration_stats = model->data->degeneration_stats;
+    stats->repetition_truncations = degeneration_stats.repetition_truncations.load(std::memory_order_relaxed);
+    stats->length_truncations = degeneration_stats.length_truncations.load(std::memory_order_relaxed);
+}
+
+void trl_reset_model_stats(const TrlModel* model) {
+    model->data->short_list_stats.reset();
+    model->data->translation_stats.reset();
+    model->data->degeneration_stats.reset();
+}
+
+void trl_get_build_info(TrlBuildInfo* info) {
+#ifdef WASM_COMPATIBLE_SOURCE
+    info->native_gemm = 0;
+    info->int_gemm_kernel = "wasm-fallback";
+    info->float_gemm_backend = "wasm-fallback";
+#else
+    info->native_gemm = 1;
+    switch (intgemm::kCPU) {
+        case intgemm::CPUType::AVX512VNNI:
+            info->int_gemm_kernel = "avx512vnni";
+            break;
+        case intgemm::CPUType::AVX512BW:
+            info->int_gemm_kernel = "avx512bw";
+            break;
+        case intgemm::CPUType::AVX2:
+            info->int_gemm_kernel = "avx2";
+            break;
+        case intgemm::CPUType::SSSE3:
+            info->int_gemm_kernel = "ssse3";
+            break;
+        case intgemm::CPUType::SSE2:
+            info->int_gemm_kernel = "sse2";
+            break;
+        default:
+            info->int_gemm_kernel = "unsupported";
+            break;
+    }
+#if defined(USE_RUY_SGEMM)
+    info->float_gemm_backend = "ruy";
+#elif defined(BLAS_FOUND)
+    info->float_gemm_backend = "blas";
+#else
+    info->float_gemm_backend = "marian";
+#endif
+#endif
+}
+
 TrlError trl_detect_language(const char* string, TrlDetectedLangInfo* result) {
 #ifdef USE_WHATLANG
     WlInfo info;
@@ -0,0 +1,171 @@
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Collects the completions of requests submitted to a batcher, in the order that they completed
+struct Completions {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::string> completed;
+    std::vector<std::string> failed;
+    std::vector<std::string> targets;
+
+    void wait_for(const size_t count) {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [this, count] { return completed.size() + failed.size() >= count; });
+    }
+};
+
+struct Request {
+    Completions* completions;
+    std::string name;
+};
+
+static void on_translated(void* user_data, const TrlString* target, const TrlError status) {
+    const Request& request = *static_cast<Request*>(user_data);
+    const trl::String owned = trl::String::adopt(target);
+    std::lock_guard guard(request.completions->mutex);
+    if (status == TRL_OK) {
+        request.completions->completed.push_back(request.name);
+        request.completions->targets.emplace_back(owned.view());
+    } else {
+        request.completions->failed.push_back(request.name);
+    }
+    request.completions->changed.notify_all();
+}
+
+static TrlBatcherStats batcher_stats(const TrlBatcher* batcher) {
+    TrlBatcherStats stats;
+    trl_get_batcher_stats(batcher, &stats);
+    return stats;
+}
+
+static const std::vector<std::string> SOURCES = {
+    "Good morning!",
+    "How are you?",
+    "The batcher translates requests from many threads together.",
+    "This is a fourth sentence.",
+    "Requests are queued until the batch is full, or the oldest has waited long enough.",
+    "Thank you.",
+};
+
+static void test_batching(const trl::Model& model) {
+    const trl::Model clone = model.clone();
+    const TrlModel* models[] = {clone.get()};
+
+    // Everything submitted within max_wait_ms of the first request is translated together
+    TrlBatcherOptions options{};
+    options.max_wait_ms = 500.0;
+    options.max_batch_words = 100000;
+    TrlBatcher* batcher = trl::detail::check(trl_create_batcher(models, 1, &options));
+    Completions completions;
+    std::vector<Request> requests;
+    requests.reserve(SOURCES.size());
+    for (const std::string& source : SOURCES) {
+        requests.push_back({&completions, source});
+    }
+    for (Request& request : requests) {
+        const trl::String source(request.name);
+        trl::detail::check(trl_batcher_submit(batcher, source.get(), nullptr, on_translated, &request));
+    }
+    completions.wait_for(SOURCES.size());
+    CHECK(completions.failed.empty());
+    const TrlBatcherStats stats = batcher_stats(batcher);
+    CHECK(stats.requests == SOURCES.size());
+    CHECK(stats.batches == 1);
+
+    // Translations are the same as when translating the batch directly
+    const trl::Batch expected = model.translate(SOURCES);
+    for (size_t i = 0; i < SOURCES.size(); i++) {
+        const auto position = std::find(completions.completed.begin(), completions.completed.end(), SOURCES[i]);
+        CHECK(position != completions.completed.end());
+        CHECK(completions.targets[position - completions.completed.begin()] == expected[i]);
+    }
+    trl_destroy_batcher(batcher);
+
+    // A full batch is translated without waiting for max_wait_ms
+    options.max_wait_ms = 60000.0;
+    options.max_batch_words = 1;
+    batcher = trl::detail::check(trl_create_batcher(models, 1, &options));
+    const auto start = std::chrono::steady_clock::now();
+    const trl::String source(SOURCES[0]);
+    const TrlString* target = nullptr;
+    trl::detail::check(trl_batcher_translate(batcher, source.get(), nullptr, &target));
+    const trl::String owned_target = trl::String::adopt(target);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(30));
+    CHECK(owned_target.view() == expected[0]);
+    trl_destroy_batcher(batcher);
+}
+
+static void test_scheduling(const trl::Model& model) {
+    const trl::Model clone = model.clone();
+    const TrlModel* models[] = {clone.get()};
+
+    // Every request is a batch of its own, so the order in which they are taken can be observed
+    TrlBatcherOptions options{};
+    options.max_wait_ms = 1.0;
+    options.max_batch_words = 1;
+    TrlBatcher* batcher = trl::detail::check(trl_create_batcher(models, 1, &options));
+    Completions completions;
+
+    // Keeps the only worker busy while the other requests are queued
+    std::string document;
+    for (size_t i = 0; i < 64; i++) {
+        document += "While this long document is translated, the other requests wait in the queue. ";
+    }
+    Request blocker{&completions, "blocker"};
+    const trl::String blocker_source(document);
+    trl::detail::check(trl_batcher_submit(batcher, blocker_source.get(), nullptr, on_translated, &blocker));
+    while (batcher_stats(batcher).batches == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const trl::String source(SOURCES[0]);
+    Request low{&completions, "low"};
+    TrlRequestOptions low_options{};
+    low_options.priority = -1;
+    trl::detail::check(trl_batcher_submit(batcher, source.get(), &low_options, on_translated, &low));
+    Request normal{&completions, "normal"};
+    trl::detail::check(trl_batcher_submit(batcher, source.get(), nullptr, on_translated, &normal));
+    Request high{&completions, "high"};
+    TrlRequestOptions high_options{};
+    high_options.priority = 10;
+    trl::detail::check(trl_batcher_submit(batcher, source.get(), &high_options, on_translated, &high));
+
+    // Expires long before the document has been translated
+    Request expiring{&completions, "expiring"};
+    TrlRequestOptions expiring_options{};
+    expiring_options.priority = 100;
+    expiring_options.timeout_ms = 1.0;
+    trl::detail::check(trl_batcher_submit(batcher, source.get(), &expiring_options, on_translated, &expiring));
+
+    Request cancelled{&completions, "cancelled"};
+    TrlCancellation* cancellation = trl_create_cancellation();
+    TrlRequestOptions cancelled_options{};
+    cancelled_options.priority = 100;
+    cancelled_options.cancellation = cancellation;
+    trl::detail::check(trl_batcher_submit(batcher, source.get(), &cancelled_options, on_translated, &cancelled));
+    trl_cancel(cancellation);
+
+    completions.wait_for(6);
+    CHECK((completions.completed == std::vector<std::string>{"blocker", "high", "normal", "low"}));
+    std::sort(completions.failed.begin(), completions.failed.end());
+    CHECK((completions.failed == std::vector<std::string>{"cancelled", "expiring"}));
+    CHECK(batcher_stats(batcher).cancelled_requests == 2);
+
+    trl_destroy_batcher(batcher);
+    trl_destroy_cancellation(cancellation);
+}
+
+int main(int argc, char* argv[]) {
+    return run_test([argc, argv] {
+        const trl::Model model = load_test_model(argc, argv);
+        test_batching(model);
+        test_scheduling(model);
+    });
+}
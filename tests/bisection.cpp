@@ -0,0 +1,92 @@
+#include "common.h"
+
+#include <bisection.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Stands in for translation: a range fails as a whole if it holds a bad item, after completing the items before it
+struct FakeBatch {
+    std::vector<bool> bad;
+    std::vector<std::shared_ptr<size_t>> results;
+    std::vector<std::string> errors;
+    std::vector<size_t> runs_per_item;
+    size_t runs = 0;
+
+    explicit FakeBatch(const size_t size): bad(size, false), results(size), errors(size), runs_per_item(size, 0) {
+    }
+
+    void run() {
+        run_bisecting(0, bad.size(), results, errors, [this](const size_t begin, const size_t end) {
+            runs++;
+            for (size_t i = begin; i < end; i++) {
+                runs_per_item[i]++;
+            }
+            for (size_t i = begin; i < end; i++) {
+                if (bad[i]) {
+                    throw std::runtime_error("Bad item " + std::to_string(i));
+                }
+                results[i] = std::make_shared<size_t>(i);
+            }
+        });
+    }
+
+    void check_isolated() const {
+        for (size_t i = 0; i < bad.size(); i++) {
+            if (bad[i]) {
+                CHECK(!results[i]);
+                CHECK(errors[i] == "Bad item " + std::to_string(i));
+            } else {
+                CHECK(results[i] && *results[i] == i);
+                CHECK(errors[i].empty());
+            }
+        }
+    }
+};
+
+int main() {
+    return run_test([] {
+        // Without failures, the whole range runs once
+        FakeBatch clean(16);
+        clean.run();
+        clean.check_isolated();
+        CHECK(clean.runs == 1);
+
+        // A single bad item is isolated in a number of runs logarithmic in the batch size
+        FakeBatch single(64);
+        single.bad[37] = true;
+        single.run();
+        single.check_isolated();
+        CHECK(single.runs <= 1 + 2 * 6);
+
+        // Items completed before a failure are not run again: the half before the bad item is never retried
+        FakeBatch first_half(8);
+        first_half.bad[6] = true;
+        first_half.run();
+        first_half.check_isolated();
+        for (size_t i = 0; i < 4; i++) {
+            CHECK(first_half.runs_per_item[i] == 1);
+        }
+
+        // Every bad item is isolated, down to a batch that fails entirely
+        FakeBatch several(10);
+        several.bad[0] = true;
+        several.bad[5] = true;
+        several.bad[9] = true;
+        several.run();
+        several.check_isolated();
+
+        FakeBatch all_bad(5);
+        std::fill(all_bad.bad.begin(), all_bad.bad.end(), true);
+        all_bad.run();
+        all_bad.check_isolated();
+
+        FakeBatch single_item(1);
+        single_item.bad[0] = true;
+        single_item.run();
+        single_item.check_isolated();
+        CHECK(single_item.runs == 1);
+    });
+}
@@ -0,0 +1,85 @@
+#ifndef TRANSLATADOR_TEST_COMMON_H
+#define TRANSLATADOR_TEST_COMMON_H
+
+#include <translatador.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+// Reported by ctest as a skipped test, rather than a failure
+static constexpr int TEST_SKIPPED = 77;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+inline std::optional<std::string> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// The directory passed by ctest from TRANSLATADOR_TEST_MODEL_DIR, or null if none was configured
+inline const char* test_model_dir(const int argc, char* argv[]) {
+    return argc > 1 && argv[1][0] ? argv[1] : nullptr;
+}
+
+// Exits with TEST_SKIPPED if no test model directory was configured
+inline const char* require_test_model_dir(const int argc, char* argv[]) {
+    const char* dir = test_model_dir(argc, argv);
+    if (!dir) {
+        std::printf("No test model configured through TRANSLATADOR_TEST_MODEL_DIR, skipping\n");
+        std::exit(TEST_SKIPPED);
+    }
+    return dir;
+}
+
+inline std::optional<std::string> read_test_file(const char* dir, const char* name) {
+    return read_file(std::string(dir) + "/" + name);
+}
+
+inline std::string require_test_file(const char* dir, const char* name) {
+    std::optional<std::string> contents = read_test_file(dir, name);
+    if (!contents) {
+        std::fprintf(stderr, "Expected %s in %s\n", name, dir);
+        std::exit(1);
+    }
+    return std::move(*contents);
+}
+
+// The configuration from config.yml in the test model directory, followed by the given options
+inline std::string test_model_config(const char* dir, const std::string& yaml_config = {}) {
+    return read_test_file(dir, "config.yml").value_or("") + "\n" + yaml_config;
+}
+
+// Loads the model from the test model directory, or exits with TEST_SKIPPED if none was configured
+inline trl::Model load_test_model(const int argc, char* argv[], const std::string& yaml_config = {}, const std::string& short_list = {}) {
+    const char* dir = require_test_model_dir(argc, argv);
+    return trl::Model::create(require_test_file(dir, "model.bin"), require_test_file(dir, "vocab.spm"), {}, short_list, test_model_config(dir, yaml_config));
+}
+
+// Runs the given test, turning errors reported by the library into a failure
+template<typename Test>
+int run_test(Test&& test) {
+    try {
+        test();
+    } catch (const trl::Error& error) {
+        std::fprintf(stderr, "Unexpected error: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "common.h"
+
+#include <greedy_search.h>
+
+#include <initializer_list>
+
+static marian::Words words_of(const std::initializer_list<size_t> indices) {
+    marian::Words words;
+    for (const size_t index : indices) {
+        words.push_back(marian::Word::fromWordIndex(index));
+    }
+    return words;
+}
+
+static std::optional<size_t> find_truncation(const DegenerationLimits& limits, const marian::Words& words, const SourceProfile& source, DegenerationStats& stats) {
+    return limits.find_truncation(words.data(), words.size(), source, stats);
+}
+
+int main() {
+    return run_test([] {
+        DegenerationStats stats;
+        const SourceProfile source{10, 0};
+        // 1 2 3, followed by the bigram 7 8 ten times
+        marian::Words looping = words_of({1, 2, 3});
+        for (size_t i = 0; i < 10; i++) {
+            looping.push_back(marian::Word::fromWordIndex(7));
+            looping.push_back(marian::Word::fromWordIndex(8));
+        }
+
+        // Nothing is cut short unless a limit is configured
+        const DegenerationLimits defaults = DegenerationLimits::parse(marian::Options());
+        CHECK(!defaults.enabled());
+        CHECK(!find_truncation(defaults, looping, source, stats));
+
+        // A loop is cut back to its first occurrence
+        const DegenerationLimits repetition{8, 4, 0.0f};
+        CHECK(repetition.enabled());
+        CHECK(find_truncation(repetition, looping, source, stats) == 5);
+        CHECK(stats.repetition_truncations.load() == 1);
+
+        // Short n-grams need more occurrences, so that output such as "very very" is left alone
+        CHECK(!find_truncation(repetition, words_of({1, 2, 5, 5, 5, 3}), source, stats));
+        CHECK(find_truncation(repetition, words_of({1, 5, 5, 5, 5, 5, 5, 5, 5}), source, stats) == 2);
+
+        // Output may repeat for as long as its source did, and is otherwise cut back to that much repetition
+        const SourceProfile repetitive_source{24, 20};
+        CHECK(!find_truncation(repetition, looping, repetitive_source, stats));
+        marian::Words long_loop = looping;
+        for (size_t i = 0; i < 10; i++) {
+            long_loop.push_back(marian::Word::fromWordIndex(7));
+            long_loop.push_back(marian::Word::fromWordIndex(8));
+        }
+        CHECK(find_truncation(repetition, long_loop, repetitive_source, stats) == 3 + 20);
+
+        // Output is cut back to length-ratio times its source, plus a fixed slack of 8 tokens
+        const DegenerationLimits length{0, 4, 2.0f};
+        const SourceProfile short_source{5, 0};
+        marian::Words distinct;
+        for (size_t i = 0; i < 18; i++) {
+            distinct.push_back(marian::Word::fromWordIndex(100 + i));
+        }
+        CHECK(!find_truncation(length, distinct, short_source, stats));
+        distinct.push_back(marian::Word::fromWordIndex(200));
+        CHECK(find_truncation(length, distinct, short_source, stats) == 18);
+        CHECK(stats.length_truncations.load() == 1);
+
+        // The loop is ignored when repetition is not detected
+        CHECK(!find_truncation(length, looping, source, stats));
+
+        stats.reset();
+        CHECK(stats.repetition_truncations.load() == 0);
+        CHECK(stats.length_truncations.load() == 0);
+    });
+}
@@ -0,0 +1,55 @@
+#include "common.h"
+
+static trl::String retranslate(const trl::Model& model, const trl::String& previous_source, const trl::String& previous_target, const trl::String& source) {
+    const TrlString* target = nullptr;
+    trl::detail::check(trl_retranslate(model.get(), previous_source.get(), previous_target.get(), source.get(), &target));
+    return trl::String::adopt(target);
+}
+
+// Source tokens that the model encoded while running the given function
+template<typename Function>
+static size_t count_source_tokens(const trl::Model& model, Function&& function) {
+    trl_reset_model_stats(model.get());
+    function();
+    return model.stats().source_tokens;
+}
+
+int main(int argc, char* argv[]) {
+    return run_test([argc, argv] {
+        const trl::Model model = load_test_model(argc, argv);
+
+        const trl::String previous_source("This is the first sentence. The second sentence is this one. And the third one ends it.");
+        const trl::String previous_target = model.translate(previous_source);
+        const trl::String source("This is the first sentence. The middle sentence was edited. And the third one ends it.");
+
+        trl::String expected;
+        const size_t full_tokens = count_source_tokens(model, [&] {
+            expected = model.translate(source);
+        });
+        CHECK(full_tokens > 0);
+
+        // Only the edited sentence is translated, and the others are taken from the previous translation
+        trl::String target;
+        const size_t edited_tokens = count_source_tokens(model, [&] {
+            target = retranslate(model, previous_source, previous_target, source);
+        });
+        CHECK(edited_tokens > 0);
+        CHECK(edited_tokens < full_tokens);
+        CHECK(target.view() == expected.view());
+
+        // Changing only the text between sentences translates nothing
+        const trl::String respaced("This is the first sentence.  The second sentence is this one.\nAnd the third one ends it.");
+        const size_t respaced_tokens = count_source_tokens(model, [&] {
+            (void) retranslate(model, previous_source, previous_target, respaced).view();
+        });
+        CHECK(respaced_tokens == 0);
+
+        // A previous target that was not translated from the previous source cannot be reused
+        const trl::String unrelated_target(previous_target.view());
+        const size_t unrelated_tokens = count_source_tokens(model, [&] {
+            target = retranslate(model, previous_source, unrelated_target, source);
+        });
+        CHECK(unrelated_tokens == full_tokens);
+        CHECK(target.view() == expected.view());
+    });
+}
@@ -0,0 +1,65 @@
+#include "common.h"
+
+#include <cstring>
+#include <vector>
+
+// Serializes the given string, and checks that deserializing it gives back the same text
+static trl::String round_trip(const trl::String& string) {
+    char* data;
+    size_t size;
+    CHECK(trl_serialize_string(string.get(), &data, &size) == TRL_OK);
+    const std::vector<char> serialized(data, data + size);
+    free(data);
+
+    // The deserialized string must not borrow the serialized data
+    std::vector<char> copy = serialized;
+    trl::String deserialized = trl::String::adopt(trl_deserialize_string(copy.data(), copy.size()));
+    std::memset(copy.data(), 0, copy.size());
+    CHECK(deserialized);
+    CHECK(deserialized.view() == string.view());
+    CHECK(deserialized.truncated() == string.truncated());
+
+    // Every truncation of the data is rejected, rather than read out of bounds
+    for (size_t length = 0; length < serialized.size(); length++) {
+        const TrlString* truncated = trl_deserialize_string(serialized.data(), length);
+        CHECK(truncated == nullptr);
+    }
+    return deserialized;
+}
+
+static size_t serialized_size(const trl::String& string) {
+    char* data;
+    size_t size;
+    CHECK(trl_serialize_string(string.get(), &data, &size) == TRL_OK);
+    free(data);
+    return size;
+}
+
+int main(int argc, char* argv[]) {
+    return run_test([argc, argv] {
+        // Plain text needs no model
+        (void) round_trip(trl::String(""));
+        (void) round_trip(trl::String("Hello, wörld! Ça va? 👋"));
+        const std::string embedded_nul("before\0after", 12);
+        (void) round_trip(trl::String(embedded_nul));
+
+        if (!test_model_dir(argc, argv)) {
+            std::printf("No test model configured through TRANSLATADOR_TEST_MODEL_DIR, skipping tokenized strings\n");
+            return;
+        }
+        const trl::Model model = load_test_model(argc, argv);
+
+        const trl::String source("The first sentence. A second, longer sentence follows it.\n\nAnd a new paragraph.");
+        const size_t plain_size = serialized_size(source);
+        CHECK(trl_tokenize_string(model.get(), source.get()) == TRL_OK);
+        CHECK(serialized_size(source) > plain_size);
+
+        // A model with the same vocabulary translates the deserialized tokens as it would the original string
+        const trl::String deserialized_source = round_trip(source);
+        const trl::String target = model.translate(source);
+        CHECK(model.translate(deserialized_source).view() == target.view());
+
+        // Translations round trip as well, along with whether they were truncated
+        (void) round_trip(target);
+    });
+}
@@ -0,0 +1,77 @@
+#include "common.h"
+
+#include <cstdio>
+#include <vector>
+
+static const char* const CACHE_PATH = "shortlist-test.cache";
+static const char* const BUNDLE_PATH = "shortlist-test.bundle";
+
+static const std::vector<std::string> SOURCES = {
+    "Hello, how are you today?",
+    "The weather is nice, so we are going for a walk in the park.",
+    "Short lists only allow the words that are likely translations of the source.",
+};
+
+static std::vector<std::string> translate_all(const trl::Model& model) {
+    const trl::Batch targets = model.translate(SOURCES);
+    std::vector<std::string> result;
+    for (size_t i = 0; i < targets.size(); i++) {
+        result.emplace_back(targets[i]);
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    return run_test([argc, argv] {
+        const char* dir = require_test_model_dir(argc, argv);
+        const std::optional<std::string> lexical_table = read_test_file(dir, "lex.s2t");
+        if (!lexical_table) {
+            std::printf("No text lexical table lex.s2t in %s, skipping\n", dir);
+            std::exit(TEST_SKIPPED);
+        }
+        std::remove(CACHE_PATH);
+        std::remove(BUNDLE_PATH);
+
+        // The text table is converted on load, and the result is cached
+        const std::string config = std::string("shortlist: [lex.s2t, 50, 50, 0.01]\nshortlist-cache: ") + CACHE_PATH + "\n";
+        const trl::Model model = load_test_model(argc, argv, config, *lexical_table);
+        const std::optional<std::string> cache = read_file(CACHE_PATH);
+        CHECK(cache.has_value());
+        const std::vector<std::string> targets = translate_all(model);
+        const TrlModelStats stats = model.stats();
+        CHECK(stats.short_list_batches > 0);
+        CHECK(stats.short_list_max_size < stats.target_vocab_size);
+
+        // Loading the same inputs again reads the cache, and translates the same
+        const trl::Model cached_model = load_test_model(argc, argv, config, *lexical_table);
+        CHECK(read_file(CACHE_PATH) == cache);
+        CHECK(translate_all(cached_model) == targets);
+        CHECK(cached_model.stats().short_list_max_size == stats.short_list_max_size);
+
+        // Other limits select fewer words, so the cache is rebuilt rather than reused
+        const std::string narrow_config = std::string("shortlist: [lex.s2t, 10, 5, 0.01]\nshortlist-cache: ") + CACHE_PATH + "\n";
+        const trl::Model narrow_model = load_test_model(argc, argv, narrow_config, *lexical_table);
+        CHECK(read_file(CACHE_PATH) != cache);
+        (void) translate_all(narrow_model);
+        CHECK(narrow_model.stats().short_list_max_size < stats.short_list_max_size);
+
+        // Packing converts the table ahead of time, selecting the same words
+        const std::string model_data = require_test_file(dir, "model.bin");
+        const std::string vocab = require_test_file(dir, "vocab.spm");
+        const std::string bundle_config = test_model_config(dir, "shortlist: [lex.s2t, 50, 50, 0.01]\n");
+        CHECK(trl_pack_bundle(
+            BUNDLE_PATH, bundle_config.c_str(),
+            model_data.data(), model_data.size(),
+            vocab.data(), vocab.size(),
+            nullptr, 0,
+            lexical_table->data(), lexical_table->size(),
+            nullptr
+        ) == TRL_OK);
+        const trl::Model bundled_model = trl::Model::from_bundle(BUNDLE_PATH, {}, true);
+        CHECK(translate_all(bundled_model) == targets);
+        CHECK(bundled_model.stats().short_list_max_size == stats.short_list_max_size);
+
+        std::remove(CACHE_PATH);
+        std::remove(BUNDLE_PATH);
+    });
+}
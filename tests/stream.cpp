@@ -0,0 +1,90 @@
+#include "common.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Hands out the text at most max_read bytes at a time, splitting characters that span reads
+struct StreamSource {
+    std::string text;
+    size_t max_read;
+    size_t position = 0;
+};
+
+struct StreamSink {
+    std::string text;
+    size_t writes = 0;
+};
+
+static int read_source(void* user_data, char* buffer, const size_t capacity, size_t* size) {
+    StreamSource& source = *static_cast<StreamSource*>(user_data);
+    const size_t read = std::min({capacity, source.max_read, source.text.size() - source.position});
+    std::memcpy(buffer, source.text.data() + source.position, read);
+    source.position += read;
+    *size = read;
+    return 0;
+}
+
+static int write_sink(void* user_data, const char* data, const size_t size) {
+    StreamSink& sink = *static_cast<StreamSink*>(user_data);
+    sink.text.append(data, size);
+    sink.writes++;
+    return 0;
+}
+
+static StreamSink translate_stream(const std::vector<const TrlModel*>& models, const std::string& text, const size_t max_read, const size_t chunk_size) {
+    StreamSource source{text, max_read};
+    StreamSink sink;
+    TrlStreamOptions options{};
+    options.chunk_size = chunk_size;
+    trl::detail::check(trl_translate_stream(models.data(), models.size(), read_source, &source, write_sink, &sink, &options));
+    return sink;
+}
+
+static bool is_valid_utf8(const std::string& text) {
+    for (size_t i = 0; i < text.size();) {
+        const auto byte = static_cast<unsigned char>(text[i]);
+        const size_t length = byte < 0x80 ? 1 : (byte & 0xE0) == 0xC0 ? 2 : (byte & 0xF0) == 0xE0 ? 3 : (byte & 0xF8) == 0xF0 ? 4 : 0;
+        if (length == 0 || i + length > text.size()) {
+            return false;
+        }
+        for (size_t j = 1; j < length; j++) {
+            if ((static_cast<unsigned char>(text[i + j]) & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    return run_test([argc, argv] {
+        const trl::Model model = load_test_model(argc, argv);
+        const trl::Model clone = model.clone();
+        const std::vector<const TrlModel*> models{model.get(), clone.get()};
+
+        // Chunks far smaller than a sentence, read a few bytes at a time such that characters span reads, still split
+        // the document into the same sentences as translating it whole
+        const std::string document =
+            "The café on the corner opens at eight. Its crêpes are famous — people queue for them.\n\n"
+            "Ça fait longtemps! Naïve visitors order the spécialité du jour, which changes every day.\n"
+            "A third paragraph: “quoted text”, emoji 👋 and a final sentence without a full stop";
+        const StreamSink sink = translate_stream(models, document, 3, 16);
+        CHECK(sink.text == model.translate(document).view());
+        CHECK(sink.writes > 1);
+
+        // A long run without sentence boundaries or spaces is still cut once it outgrows 16 times the chunk size,
+        // between its tokens or whole characters
+        std::string unbroken;
+        for (size_t i = 0; i < 1000; i++) {
+            unbroken += "é";
+        }
+        const StreamSink unbroken_sink = translate_stream(models, unbroken, 5, 8);
+        CHECK(unbroken_sink.writes > 1);
+        CHECK(is_valid_utf8(unbroken_sink.text));
+
+        // Reading the whole text at once makes no difference
+        CHECK(translate_stream(models, document, document.size(), 16).text == sink.text);
+    });
+}
@@ -0,0 +1,179 @@
+#include <translatador.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tunes a model for this machine over a sample corpus with one segment per line, and writes the recommended YAML
+// configuration, which can be passed as the config of trl_create_model_from_bundle on this machine from then on.
+
+long read_file(const char* file_name, char** result) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+
+    // Leave space for a NUL terminator, so that configuration files can be used as strings
+    char* buffer = malloc(size + 1);
+    if (fread(buffer, 1, size, file) != (size_t)size) {
+        free(buffer);
+        fclose(file);
+        return -1;
+    }
+    buffer[size] = 0;
+    fclose(file);
+
+    *result = buffer;
+    return size;
+}
+
+// Parses a comma-separated list of sizes in place, returning the number of values or 0 if malformed
+size_t parse_sizes(char* list, size_t** result) {
+    size_t count = 1;
+    for (const char* c = list; *c; c++) {
+        if (*c == ',') {
+            count++;
+        }
+    }
+
+    size_t* values = malloc(count * sizeof(size_t));
+    size_t index = 0;
+    for (char* value = strtok(list, ","); value; value = strtok(0, ",")) {
+        char* end;
+        values[index++] = (size_t)strtoul(value, &end, 10);
+        if (end == value || *end) {
+            free(values);
+            return 0;
+        }
+    }
+
+    *result = values;
+    return index;
+}
+
+void print_usage() {
+    printf("Usage: <model bundle> <sample text file> [--config <yaml file>] [--output <yaml file>] [--clones <n,...>] [--mini-batch-words <n,...>] [--max-length-break <n,...>] [--workspace <mb,...>] [--iterations <count>] [--max-p99-latency <ms>]\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    const char* bundle_file = argv[1];
+    const char* sample_file = argv[2];
+    const char* config_file = 0;
+    const char* output_file = 0;
+    TrlAutotuneOptions options = {0};
+
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage();
+            return 1;
+        }
+        size_t** list = 0;
+        size_t* list_count = 0;
+        if (strcmp(argv[i], "--config") == 0) {
+            config_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--clones") == 0) {
+            list = (size_t**)&options.clone_counts;
+            list_count = &options.clone_count_count;
+        } else if (strcmp(argv[i], "--mini-batch-words") == 0) {
+            list = (size_t**)&options.mini_batch_words;
+            list_count = &options.mini_batch_words_count;
+        } else if (strcmp(argv[i], "--max-length-break") == 0) {
+            list = (size_t**)&options.max_length_breaks;
+            list_count = &options.max_length_break_count;
+        } else if (strcmp(argv[i], "--workspace") == 0) {
+            list = (size_t**)&options.workspaces;
+            list_count = &options.workspace_count;
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            options.iterations = (size_t)atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--max-p99-latency") == 0) {
+            options.max_p99_latency_ms = atof(argv[i + 1]);
+        } else {
+            print_usage();
+            return 1;
+        }
+        if (list && (*list_count = parse_sizes(argv[i + 1], list)) == 0) {
+            print_usage();
+            return 1;
+        }
+    }
+
+    char* config = 0;
+    if (config_file && read_file(config_file, &config) < 0) {
+        printf("Failed to read %s\n", config_file);
+        return 1;
+    }
+    char* samples_text;
+    if (read_file(sample_file, &samples_text) < 0) {
+        printf("Failed to read %s\n", sample_file);
+        return 1;
+    }
+
+    size_t sample_capacity = 64;
+    size_t sample_count = 0;
+    const TrlString** samples = malloc(sample_capacity * sizeof(TrlString*));
+    for (const char* line = strtok(samples_text, "\r\n"); line; line = strtok(0, "\r\n")) {
+        if (sample_count == sample_capacity) {
+            sample_capacity *= 2;
+            samples = realloc(samples, sample_capacity * sizeof(TrlString*));
+        }
+        samples[sample_count++] = trl_create_string(line);
+    }
+    if (sample_count == 0) {
+        printf("No sample lines in %s\n", sample_file);
+        return 1;
+    }
+
+    const TrlModel* model = trl_create_model_from_bundle(bundle_file, config, 0);
+    if (!model) {
+        char* last_error = trl_get_last_error();
+        printf("Failed to load model: %s\n", last_error);
+        free(last_error);
+        return 1;
+    }
+
+    printf("Tuning over %zu sample lines, this may take a while...\n", sample_count);
+    TrlAutotuneResult result;
+    if (trl_autotune(model, samples, sample_count, &options, &result)) {
+        char* last_error = trl_get_last_error();
+        printf("Failed to tune model: %s\n", last_error);
+        free(last_error);
+        return 1;
+    }
+    printf("Recommended %zu clones, mini-batch-words %zu, max-length-break %zu, workspace %zu: %.1f tokens/sec, p99 latency %.1f ms\n",
+           result.clones, result.mini_batch_words, result.max_length_break, result.workspace, result.tokens_per_second, result.p99_latency_ms);
+
+    if (output_file) {
+        FILE* output = fopen(output_file, "wb");
+        if (!output || fputs(result.config, output) < 0) {
+            printf("Failed to write %s\n", output_file);
+            return 1;
+        }
+        fclose(output);
+    } else {
+        printf("%s", result.config);
+    }
+
+    for (size_t i = 0; i < sample_count; i++) {
+        trl_destroy_string(samples[i]);
+    }
+    free(samples);
+    free(samples_text);
+    free(config);
+    free(result.config);
+    free((void*)options.clone_counts);
+    free((void*)options.mini_batch_words);
+    free((void*)options.max_length_breaks);
+    free((void*)options.workspaces);
+    trl_destroy_model(model);
+    return 0;
+}
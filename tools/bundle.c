@@ -0,0 +1,103 @@
+#include <translatador.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+long read_file(const char* file_name, char** result) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+
+    // Leave space for a NUL terminator, so that configuration files can be used as strings
+    char* buffer = malloc(size + 1);
+    if (fread(buffer, 1, size, file) != (size_t)size) {
+        free(buffer);
+        fclose(file);
+        return -1;
+    }
+    buffer[size] = 0;
+    fclose(file);
+
+    *result = buffer;
+    return size;
+}
+
+void print_usage() {
+    printf("Usage: <output bundle> <model file> <vocab file> [--target-vocab <file>] [--short-list <file>] [--config <yaml file>] [--cpu <tag>]\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        print_usage();
+        return 1;
+    }
+
+    const char* output_file = argv[1];
+    const char* model_file = argv[2];
+    const char* vocab_file = argv[3];
+    const char* target_vocab_file = 0;
+    const char* short_list_file = 0;
+    const char* config_file = 0;
+    const char* cpu = 0;
+
+    for (int i = 4; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage();
+            return 1;
+        }
+        if (strcmp(argv[i], "--target-vocab") == 0) {
+            target_vocab_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--short-list") == 0) {
+            short_list_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--config") == 0) {
+            config_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--cpu") == 0) {
+            cpu = argv[i + 1];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    const char* input_files[] = {model_file, vocab_file, target_vocab_file, short_list_file, config_file};
+    char* buffers[5] = {0};
+    long sizes[5] = {0};
+    for (int i = 0; i < 5; i++) {
+        if (input_files[i]) {
+            sizes[i] = read_file(input_files[i], &buffers[i]);
+            if (sizes[i] < 0) {
+                printf("Failed to read %s\n", input_files[i]);
+                return 1;
+            }
+        }
+    }
+
+    const TrlError error = trl_pack_bundle(
+        output_file,
+        buffers[4],
+        buffers[0], sizes[0],
+        buffers[1], sizes[1],
+        buffers[2], sizes[2],
+        buffers[3], sizes[3],
+        cpu
+    );
+
+    for (int i = 0; i < 5; i++) {
+        free(buffers[i]);
+    }
+
+    if (error) {
+        char* last_error = trl_get_last_error();
+        printf("Failed to pack bundle: %s\n", last_error);
+        free(last_error);
+        return 1;
+    }
+
+    printf("Packed bundle to %s\n", output_file);
+    return 0;
+}